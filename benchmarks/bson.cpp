@@ -0,0 +1,60 @@
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+
+#include <ejdb/ejdb.h>
+
+#include <meteorpp/bson.hpp>
+
+template<typename F>
+double measure(std::size_t iterations, F f)
+{
+    auto const start = std::chrono::steady_clock::now();
+    for(std::size_t i = 0; i < iterations; ++i) {
+        f();
+    }
+    std::chrono::duration<double, std::micro> const elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / iterations;
+}
+
+nlohmann::json text_round_trip(nlohmann::json const& doc)
+{
+    std::shared_ptr<bson> value(json2bson(doc.dump().c_str()), bson_del);
+    char* buffer;
+    int size = 0;
+    bson2json(bson_data(value.get()), &buffer, &size);
+    auto const result = nlohmann::json::parse(std::string(buffer, size));
+    free(buffer);
+    return result;
+}
+
+nlohmann::json native_round_trip(nlohmann::json const& doc)
+{
+    auto const value = meteorpp::json_to_bson(doc);
+    return meteorpp::bson_to_json(bson_data(value.get()));
+}
+
+void run(std::string const& name, nlohmann::json const& doc, std::size_t iterations)
+{
+    auto const text = measure(iterations, [&]() { text_round_trip(doc); });
+    auto const native = measure(iterations, [&]() { native_round_trip(doc); });
+    std::cout << name << ": text " << text << "us, native " << native << "us, speedup " << text / native << "x" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    nlohmann::json const small = {{ "_id", "d776bb695e5447997999b1fd" }, { "foo", "bar" }, { "count", 42 }};
+
+    nlohmann::json nested = small;
+    nested["profile"] = {{ "name", "foo" }, { "address", {{ "street", "bar" }, { "zip", 1234 }, { "geo", { 1.5, 2.5 }} }}, { "tags", { "a", "b", "c" }}};
+
+    nlohmann::json large = small;
+    for(int i = 0; i < 1000; ++i) {
+        large["field" + std::to_string(i)] = {{ "value", i }, { "label", "item " + std::to_string(i) }, { "ratio", i / 3.0 }};
+    }
+
+    run("small", small, 100000);
+    run("nested", nested, 100000);
+    run("large", large, 1000);
+    return 0;
+}
@@ -0,0 +1,57 @@
+#include <chrono>
+#include <iostream>
+
+#include <meteorpp/collection.hpp>
+#include <meteorpp/live_query.hpp>
+
+template<typename F>
+double measure(F f)
+{
+    auto const start = std::chrono::steady_clock::now();
+    f();
+    std::chrono::duration<double> const elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+void run(std::size_t count, std::size_t live_queries)
+{
+    std::vector<nlohmann::json::object_t> documents;
+    documents.reserve(count);
+    for(std::size_t i = 0; i < count; ++i) {
+        documents.push_back({{ "index", i }, { "group", i % 10 }, { "label", "item " + std::to_string(i) }});
+    }
+
+    double looped, batched;
+    {
+        auto coll = std::make_shared<meteorpp::collection>("looped");
+        std::vector<std::shared_ptr<meteorpp::live_query>> queries;
+        for(std::size_t i = 0; i < live_queries; ++i) {
+            queries.push_back(coll->track({{ "group", i % 10 }}));
+        }
+        looped = measure([&]() {
+            for(auto const& document: documents) {
+                coll->insert(document);
+            }
+        });
+    }
+    {
+        auto coll = std::make_shared<meteorpp::collection>("batched");
+        std::vector<std::shared_ptr<meteorpp::live_query>> queries;
+        for(std::size_t i = 0; i < live_queries; ++i) {
+            queries.push_back(coll->track({{ "group", i % 10 }}));
+        }
+        batched = measure([&]() {
+            coll->insert_many(documents);
+        });
+    }
+
+    std::cout << count << " documents, " << live_queries << " live queries: insert " << count / looped << " docs/s, insert_many " << count / batched << " docs/s" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    run(10000, 0);
+    run(10000, 10);
+    run(50000, 10);
+    return 0;
+}
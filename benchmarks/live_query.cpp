@@ -0,0 +1,44 @@
+#include <chrono>
+#include <iostream>
+
+#include <meteorpp/collection.hpp>
+#include <meteorpp/live_query.hpp>
+#include <meteorpp/memory_collection.hpp>
+
+template<typename F>
+double measure(F f)
+{
+    auto const start = std::chrono::steady_clock::now();
+    f();
+    std::chrono::duration<double> const elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+template<typename collection_t>
+void run(std::string const& engine, std::size_t count, std::size_t live_queries)
+{
+    auto coll = std::make_shared<collection_t>("live_query_" + std::to_string(live_queries));
+    std::vector<std::shared_ptr<meteorpp::live_query>> queries;
+    for(std::size_t i = 0; i < live_queries; ++i) {
+        queries.push_back(coll->track({{ "group", i % 100 }, { "index", {{ "$gte", 0 }} }}));
+    }
+
+    auto const elapsed = measure([&]() {
+        for(std::size_t i = 0; i < count; ++i) {
+            coll->insert({{ "index", i }, { "group", i % 100 }, { "label", "item " + std::to_string(i) }});
+        }
+    });
+
+    std::cout << engine << ", " << live_queries << " live queries: " << elapsed / count * 1e6 << " us/insert" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    for(auto live_queries: { 0, 1, 10, 100, 1000 }) {
+        run<meteorpp::collection>("ejdb", 5000, live_queries);
+    }
+    for(auto live_queries: { 0, 1, 10, 100, 1000 }) {
+        run<meteorpp::memory_collection>("memory", 5000, live_queries);
+    }
+    return 0;
+}
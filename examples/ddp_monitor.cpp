@@ -84,6 +84,7 @@ int main(int argc, char** argv)
             }
             coll->on_ready([&]() {
                 live_query = coll->track();
+                live_query->coalesce(io, boost::posix_time::milliseconds(100));
                 live_query->on_changed(std::bind(print_live_query, live_query));
                 print_live_query(live_query);
             });
@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2015, Mario Flach. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef __meteorpp_bson_hpp__
+#define __meteorpp_bson_hpp__
+
+#include <memory>
+
+#include <ejdb/bson.h>
+#include <nlohmann/json.hpp>
+
+namespace meteorpp {
+    /* Appends the fields of a JSON object (or the elements of a JSON array) to an unfinished BSON document.
+     */
+    void append_to_bson(bson* out, nlohmann::json const& value) throw(std::invalid_argument);
+
+    /* Appends a single JSON value to an unfinished BSON document under the given key.
+     */
+    void append_to_bson(bson* out, char const* key, nlohmann::json const& value) throw(std::invalid_argument);
+
+    /* Encodes a JSON object into a finished BSON document.
+     */
+    std::shared_ptr<bson> json_to_bson(nlohmann::json const& value) throw(std::invalid_argument);
+
+    /* Decodes a raw BSON document into a JSON object.
+     */
+    nlohmann::json bson_to_json(char const* data);
+}
+
+#endif
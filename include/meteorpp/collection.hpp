@@ -24,29 +24,67 @@
 #ifndef __meteorpp_collection_hpp__
 #define __meteorpp_collection_hpp__
 
+#include <list>
+#include <unordered_map>
+
 #include <boost/signals2/signal.hpp>
 
 #include <ejdb/bson.h>
 #include <nlohmann/json.hpp>
 
+#include "cursor.hpp"
+#include "live_query_router.hpp"
+#include "selector.hpp"
+#include "sort_order.hpp"
+
 struct EJDB;
 struct EJCOLL;
+struct EJQ;
 
 namespace meteorpp {
+    class live_aggregate;
     class live_query;
+    class live_query_multiplexer;
+    class prepared_query;
+
+    /* Sort specification, skip, limit and projection of a query.
+     */
+    struct find_options
+    {
+        sort_order::specification sort;
+        std::size_t skip = 0;
+        std::size_t limit = 0;
+        nlohmann::json::object_t fields;
+    };
 
-    class collection_base
+    class collection_base : public std::enable_shared_from_this<collection_base>
     {
+        friend class live_aggregate;
+        friend class live_query;
+        friend class live_query_multiplexer;
+
         public:
         typedef boost::signals2::signal<void(std::string const& id, nlohmann::json::object_t const& fields)> document_added_signal;
         typedef boost::signals2::signal<void(std::string const& id, nlohmann::json::object_t const& fields, std::vector<std::string> const& cleared)> document_changed_signal;
         typedef boost::signals2::signal<void(std::string const& id)> document_removed_signal;
 
+        collection_base();
+
+        virtual ~collection_base();
+
+        /* Tracks the documents matching a selector, only the sort and limit options are used.
+         */
+        std::shared_ptr<live_query> track(nlohmann::json::object_t const& selector = nlohmann::json::object(), find_options const& options = find_options()) throw(std::bad_weak_ptr, std::runtime_error);
+
+        /* Keeps count, sum, min and max of a field over the documents matching a selector up to date, optionally grouped by another field.
+         */
+        std::shared_ptr<live_aggregate> aggregate(nlohmann::json::object_t const& selector, std::string const& field, std::string const& group_by = std::string()) throw(std::bad_weak_ptr, std::runtime_error);
+
         virtual int count(nlohmann::json::object_t const& selector = nlohmann::json::object()) throw(std::runtime_error) = 0;
 
-        virtual std::vector<nlohmann::json::object_t> find(nlohmann::json::object_t const& selector = nlohmann::json::object()) throw(std::runtime_error) = 0;
+        virtual std::vector<nlohmann::json::object_t> find(nlohmann::json::object_t const& selector = nlohmann::json::object(), find_options const& options = find_options()) throw(std::runtime_error) = 0;
 
-        virtual nlohmann::json::object_t find_one(nlohmann::json::object_t const& selector = nlohmann::json::object()) throw(std::runtime_error) = 0;
+        virtual nlohmann::json::object_t find_one(nlohmann::json::object_t const& selector = nlohmann::json::object(), find_options const& options = find_options()) throw(std::runtime_error) = 0;
 
         virtual std::string insert(nlohmann::json::object_t const& document) throw(std::runtime_error) = 0;
 
@@ -56,10 +94,59 @@ namespace meteorpp {
 
         virtual int remove(nlohmann::json::object_t const& selector) throw(std::runtime_error) = 0;
 
+        virtual std::vector<std::string> insert_many(std::vector<nlohmann::json::object_t> const& documents) throw(std::runtime_error) = 0;
+
+        virtual int update_many(std::vector<std::pair<nlohmann::json::object_t, nlohmann::json::object_t>> const& updates) throw(std::runtime_error) = 0;
+
+        virtual int remove_many(std::vector<nlohmann::json::object_t> const& selectors) throw(std::runtime_error) = 0;
+
+        protected:
+        typedef boost::signals2::signal<void(std::string const& id, nlohmann::json::object_t const& before, nlohmann::json::object_t const& after)> document_pre_changed_signal;
+        typedef boost::signals2::signal<void(std::string const& id, nlohmann::json::object_t const& document)> document_pre_removed_signal;
+        typedef boost::signals2::signal<void()> batch_committed_signal;
+
+        struct changeset
+        {
+            void merge(changeset&& other);
+
+            std::map<std::string, std::pair<nlohmann::json::object_t, nlohmann::json::object_t>> changed;
+            std::map<std::string, nlohmann::json::object_t> removed;
+        };
+
+        /* Compiles a selector into a predicate which evaluates documents in memory, once per live query.
+         */
+        virtual selector::predicate matcher(nlohmann::json::object_t const& selector) throw(std::runtime_error);
+
+        /* Returns whether $gt and $lt select strings, ids included, in the order the collection sorts them, so that
+         * limited live queries can fetch the documents following their last result by range.
+         */
+        virtual bool selects_ranges_in_sort_order() const;
+
+        /* Returns the shared results of the given query, creating them if no live query tracks it yet.
+         */
+        std::shared_ptr<live_query_multiplexer> multiplex(nlohmann::json::object_t const& selector, find_options const& options) throw(std::bad_weak_ptr, std::runtime_error);
+
+        void notify_changes(changeset const& changes);
+
+        void notify_batch(std::function<void()> const& notify);
+
+        /* Returns the dotted paths set ("fields") and unset ("cleared") from a to b, descending into nested objects
+         * so that a change deep in a subtree only reports the leaves which differ. Arrays are compared as a whole.
+         */
+        static nlohmann::json modified_fields(nlohmann::json::object_t const& a, nlohmann::json::object_t const& b);
+
         protected:
         document_added_signal document_added;
         document_changed_signal document_changed;
         document_removed_signal document_removed;
+        document_pre_changed_signal document_pre_changed;
+        document_pre_removed_signal document_pre_removed;
+        batch_committed_signal batch_committed;
+
+        private:
+        int _batch_depth = 0;
+        live_query_router _router;
+        std::map<std::string, std::weak_ptr<live_query_multiplexer>> _multiplexers;
     };
 
     class ejdb_exception : public std::runtime_error
@@ -77,25 +164,53 @@ namespace meteorpp {
         int _error_code;
     };
 
-    class collection : public collection_base, public std::enable_shared_from_this<collection>
+    class collection : public collection_base
     {
-        typedef boost::signals2::signal<void(std::string const& id, nlohmann::json::object_t const& before, nlohmann::json::object_t const& after)> document_pre_changed_signal;
-        typedef boost::signals2::signal<void(std::string const& id, nlohmann::json::object_t const& document)> document_pre_removed_signal;
-
-        friend class live_query;
+        friend class prepared_query;
 
         public:
+        enum class index_type
+        {
+            string,
+            istring,
+            number,
+            array
+        };
+
+        enum class open_mode
+        {
+            truncate,
+            keep
+        };
+
         collection(std::string const& name) throw(ejdb_exception);
 
         virtual ~collection();
 
-        std::shared_ptr<live_query> track(nlohmann::json::object_t const& selector = nlohmann::json::object()) throw(std::bad_weak_ptr);
+        /* Sets the file and open mode of the database shared by all collections, "meteorpp.db" truncated by default.
+         * Takes effect the next time the database is opened, that is when no collection is alive.
+         */
+        static void set_database(std::string const& path, open_mode mode = open_mode::truncate);
+
+        /* Compiles a selector once so that it can be executed many times.
+         */
+        std::shared_ptr<prepared_query> prepare(nlohmann::json::object_t const& selector = nlohmann::json::object(), find_options const& options = find_options()) throw(std::bad_weak_ptr, ejdb_exception);
+
+        /* Sets how many compiled selectors are kept for reuse by ad-hoc queries (0 disables the cache).
+         * Updates and removes are compiled each time, their modifiers rarely repeat.
+         */
+        void set_query_cache_capacity(std::size_t capacity);
 
         virtual int count(nlohmann::json::object_t const& selector = nlohmann::json::object()) throw(std::runtime_error);
 
-        virtual std::vector<nlohmann::json::object_t> find(nlohmann::json::object_t const& selector = nlohmann::json::object()) throw(std::runtime_error);
+        virtual std::vector<nlohmann::json::object_t> find(nlohmann::json::object_t const& selector = nlohmann::json::object(), find_options const& options = find_options()) throw(std::runtime_error);
+
+        virtual nlohmann::json::object_t find_one(nlohmann::json::object_t const& selector = nlohmann::json::object(), find_options const& options = find_options()) throw(std::runtime_error);
 
-        virtual nlohmann::json::object_t find_one(nlohmann::json::object_t const& selector = nlohmann::json::object()) throw(std::runtime_error);
+        /* Returns a cursor over the matching documents which decodes them as it advances. The query runs to
+         * completion first, so the raw results of all matching documents are held in memory.
+         */
+        cursor find_cursor(nlohmann::json::object_t const& selector = nlohmann::json::object(), find_options const& options = find_options()) throw(ejdb_exception);
 
         virtual std::string insert(nlohmann::json::object_t const& document) throw(std::runtime_error);
 
@@ -105,25 +220,75 @@ namespace meteorpp {
 
         virtual int remove(nlohmann::json::object_t const& selector) throw(std::runtime_error);
 
+        /* Inserts the given documents within a single transaction.
+         */
+        virtual std::vector<std::string> insert_many(std::vector<nlohmann::json::object_t> const& documents) throw(std::runtime_error);
+
+        /* Applies the given selector/modifier pairs within a single transaction.
+         */
+        virtual int update_many(std::vector<std::pair<nlohmann::json::object_t, nlohmann::json::object_t>> const& updates) throw(std::runtime_error);
+
+        /* Removes the documents matching any of the given selectors within a single transaction.
+         */
+        virtual int remove_many(std::vector<nlohmann::json::object_t> const& selectors) throw(std::runtime_error);
+
+        /* Creates an index of the given type on a field path, if it does not exist yet.
+         */
+        void ensure_index(std::string const& path, index_type type = index_type::string) throw(ejdb_exception);
+
+        /* Drops the index of the given type on a field path.
+         */
+        void drop_index(std::string const& path, index_type type) throw(ejdb_exception);
+
+        /* Drops all indexes on a field path.
+         */
+        void drop_index(std::string const& path) throw(ejdb_exception);
+
+        /* Returns the indexed field paths along with their index type.
+         */
+        std::vector<std::pair<std::string, index_type>> indexes() throw(ejdb_exception);
+
         protected:
-        nlohmann::json query(nlohmann::json::object_t const& selector, nlohmann::json::object_t const& modifier = nlohmann::json::object(), int flags = 0) throw(ejdb_exception);
+        /* Falls back to matching with EJDB for selectors the native matcher does not support.
+         */
+        virtual selector::predicate matcher(nlohmann::json::object_t const& selector) throw(std::runtime_error);
+
+        /* EJDB only compares numbers with $gt and $lt.
+         */
+        virtual bool selects_ranges_in_sort_order() const;
+
+        nlohmann::json query(nlohmann::json::object_t const& selector, nlohmann::json::object_t const& modifier = nlohmann::json::object(), int flags = 0, changeset* changes = nullptr) throw(ejdb_exception);
+
+        std::shared_ptr<EJQ> compile(nlohmann::json::object_t const& selector, nlohmann::json::object_t const& modifier = nlohmann::json::object(), find_options const& options = find_options()) throw(ejdb_exception);
+
+        nlohmann::json execute(EJQ* ejdb_query, nlohmann::json::object_t const& modifier = nlohmann::json::object(), int flags = 0, changeset* changes = nullptr) throw(ejdb_exception);
+
+        cursor execute_cursor(EJQ* ejdb_query) throw(ejdb_exception);
 
-        nlohmann::json evaluate_log(std::string const& log);
+        changeset evaluate_changes(std::vector<nlohmann::json::object_t> const& results, nlohmann::json::object_t const& modifier);
+
+        void run_in_transaction(std::function<void()> const& work) throw(ejdb_exception);
+
+        std::string save_document(bson* buffer, nlohmann::json::object_t const& document) throw(ejdb_exception);
 
         void throw_last_ejdb_exception() throw(ejdb_exception);
 
         protected:
-        static nlohmann::json modified_fields(nlohmann::json::object_t const& a, nlohmann::json::object_t const& b);
-
         static nlohmann::json convert_to_json(std::shared_ptr<bson> const& value);
 
         static std::shared_ptr<bson> convert_to_bson(nlohmann::json const& value);
 
+        /* Encodes the options as EJDB query hints, keeping the order of the sort keys, or returns null if there are none.
+         */
+        static std::shared_ptr<bson> query_hints(find_options const& options);
+
         private:
-        document_pre_changed_signal document_pre_changed;
-        document_pre_removed_signal document_pre_removed;
+        std::string _name;
         std::shared_ptr<EJDB> _db;
         std::shared_ptr<EJCOLL> _coll;
+        std::size_t _query_cache_capacity = 64;
+        std::list<std::pair<std::string, std::shared_ptr<EJQ>>> _query_cache;
+        std::unordered_map<std::string, std::list<std::pair<std::string, std::shared_ptr<EJQ>>>::iterator> _query_cache_index;
     };
 }
 
@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2015, Mario Flach. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef __meteorpp_cursor_hpp__
+#define __meteorpp_cursor_hpp__
+
+#include <iterator>
+#include <memory>
+
+#include <nlohmann/json.hpp>
+
+namespace meteorpp {
+    class collection;
+
+    /* Iterates over the results of a query, decoding each document only once it is reached.
+     *
+     * This is not a streaming cursor: EJDB executes the whole query up front and the cursor keeps the complete
+     * result list (the raw BSON of every matching document) until it is destroyed. Only the conversion to JSON
+     * is deferred, so use find_options::limit and skip to bound the memory of large result sets.
+     */
+    class cursor
+    {
+        friend class collection;
+
+        public:
+        class iterator : public std::iterator<std::input_iterator_tag, nlohmann::json::object_t const>
+        {
+            public:
+            iterator();
+
+            iterator(cursor* cursor, std::size_t position);
+
+            nlohmann::json::object_t const& operator*() const;
+
+            nlohmann::json::object_t const* operator->() const;
+
+            iterator& operator++();
+
+            iterator operator++(int);
+
+            bool operator==(iterator const& other) const;
+
+            bool operator!=(iterator const& other) const;
+
+            private:
+            cursor* _cursor;
+            std::size_t _position;
+        };
+
+        virtual ~cursor();
+
+        /* Returns the number of documents matched by the query.
+         */
+        std::size_t count() const;
+
+        iterator begin();
+
+        iterator end();
+
+        private:
+        cursor(void* result, std::size_t count);
+
+        nlohmann::json::object_t const& document(std::size_t position);
+
+        private:
+        std::shared_ptr<void> _result;
+        std::size_t _count;
+        std::size_t _position;
+        nlohmann::json::object_t _document;
+    };
+}
+
+#endif
@@ -24,6 +24,10 @@
 #ifndef __meteorpp_ddp_hpp__
 #define __meteorpp_ddp_hpp__
 
+#include <unordered_map>
+#include <unordered_set>
+
+#include <boost/asio/deadline_timer.hpp>
 #include <boost/signals2/signal.hpp>
 
 #include <nlohmann/json.hpp>
@@ -37,8 +41,17 @@ namespace meteorpp {
         typedef websocketpp::client<websocketpp::config::asio> client;
 
         public:
+        enum class subscription_state
+        {
+            pending,
+            ready,
+            failed,
+            stopped
+        };
+
         typedef boost::signals2::signal<void(std::string const& session)> connected_signal;
         typedef boost::signals2::signal<void(std::string const& id)> ready_signal;
+        typedef boost::signals2::signal<void(std::string const& id, nlohmann::json const& error)> nosub_signal;
         typedef boost::signals2::signal<void(std::string const& id, nlohmann::json const& result, nlohmann::json const& error)> method_result_signal;
         typedef boost::signals2::signal<void(std::string const& id)> method_updated_signal;
         typedef boost::signals2::signal<void(std::string const& collection, std::string const& id, nlohmann::json::object_t const& fields)> document_added_signal;
@@ -56,25 +69,59 @@ namespace meteorpp {
         std::string session() const;
 
         /* Attempts to establish a WebSocket connection to a Meteor app.
+         * The connection is reestablished whenever it drops, resuming the session and replaying the active subscriptions.
          */
         void connect(std::string const& url = "ws://locahost:3000/websocket", connected_signal::slot_type const& slot = connected_signal::slot_function_type()) throw(websocketpp::exception);
 
         /* Invokes a server method passing any number of arguments.
+         * If a timeout is given and no result came within it, the slot is called with a "timeout" error instead.
+         * If the connection drops before the result came, the slot is called with a "disconnected" error.
+         */
+        std::string call_method(std::string const& name, nlohmann::json::array_t const& params = nlohmann::json::array(), method_result_signal::slot_type const& slot = method_result_signal::slot_function_type(), boost::posix_time::time_duration const& timeout = boost::posix_time::time_duration()) throw(websocketpp::exception);
+
+        /* Returns the number of method calls still waiting for their result.
+         */
+        std::size_t pending_methods() const;
+
+        /* Subscribes to a record set, the error slot is called if the server refuses or aborts the subscription.
+         * The slot is called whenever the subscription becomes ready, that is again after each reconnection.
+         */
+        std::string subscribe(std::string const& name, nlohmann::json::array_t const& params = nlohmann::json::array(), ready_signal::slot_type const& slot = ready_signal::slot_function_type(), nosub_signal::slot_type const& error_slot = nosub_signal::slot_function_type()) throw(websocketpp::exception);
+
+        /* Sets how long outgoing messages may be held to be written together, and how many of them at most (0 for no limit).
+         * By default they are written together once the current handler of the io_service returns.
          */
-        std::string call_method(std::string const& name, nlohmann::json::array_t const& params = nlohmann::json::array(), method_result_signal::slot_type const& slot = method_result_signal::slot_function_type()) throw(websocketpp::exception);
+        void set_send_batching(boost::posix_time::time_duration const& max_delay, std::size_t max_batch_size);
 
-        /* Subscribes to a record set.
+        /* Sets how many outgoing messages may wait for the session to be established (0 for no limit, 1024 by default).
+         * Once it is reached, method calls and subscriptions throw until the connection is back.
          */
-        std::string subscribe(std::string const& name, nlohmann::json::array_t const& params = nlohmann::json::array(), ready_signal::slot_type const& slot = ready_signal::slot_function_type()) throw(websocketpp::exception);
+        void set_max_queued_messages(std::size_t max_queued);
 
-        /* Unsubscribes from a record set.
+        /* Sets the delay before the first reconnection attempt, doubled after each failed attempt up to the given maximum
+         * and shortened randomly by up to a half to spread the clients reconnecting at once. A zero initial delay disables reconnection.
+         */
+        void set_reconnect_delay(boost::posix_time::time_duration const& initial, boost::posix_time::time_duration const& maximum);
+
+        /* Unsubscribes from a record set, or forgets a failed subscription.
+         * If the sub message is still waiting for the connection, the unsub message is queued behind it.
          */
         void unsubscribe(std::string const& id) throw(websocketpp::exception);
 
+        /* Returns the state of a subscription, stopped if it is unknown.
+         */
+        subscription_state subscription_status(std::string const& id) const;
+
         boost::signals2::connection on_connected(connected_signal::slot_type const& slot);
 
+        /* Notifies that the connection was reestablished, before the active subscriptions are replayed.
+         */
+        boost::signals2::connection on_reconnected(connected_signal::slot_type const& slot);
+
         boost::signals2::connection on_ready(ready_signal::slot_type const& slot);
 
+        boost::signals2::connection on_nosub(nosub_signal::slot_type const& slot);
+
         boost::signals2::connection on_synchronized(method_updated_signal::slot_type const& slot);
 
         boost::signals2::connection on_document_added(document_added_signal::slot_type const& slot);
@@ -84,21 +131,105 @@ namespace meteorpp {
         boost::signals2::connection on_document_removed(document_removed_signal::slot_type const& slot);
 
         private:
+        enum class message_type
+        {
+            unknown,
+            connected,
+            failed,
+            ping,
+            error,
+            nosub,
+            added,
+            changed,
+            removed,
+            ready,
+            updated,
+            result
+        };
+
+        struct pending_method
+        {
+            method_result_signal::slot_type slot;
+            std::unique_ptr<boost::asio::deadline_timer> timer;
+        };
+
+        struct subscription
+        {
+            std::string name;
+            nlohmann::json::array_t params;
+            subscription_state state;
+            ready_signal::slot_type ready_slot;
+            nosub_signal::slot_type error_slot;
+        };
+
         std::string random_id(unsigned int length = 17) const;
 
         std::string random_method_id() const;
 
         void init_session();
 
+        /* Queues a message to be written along with the others sent until the next flush.
+         */
+        void send(nlohmann::json const& payload) throw(websocketpp::exception);
+
+        /* Queues a message and marks its id as queued, before the message can be written by a flush the queue triggers.
+         */
+        void send(nlohmann::json const& payload, std::unordered_set<std::string>& queued, std::string const& id) throw(websocketpp::exception);
+
+        /* Writes the queued messages in a row so that the transport gathers them, once the session is established.
+         */
+        void flush_outbound();
+
+        void open_connection();
+
+        void on_closed();
+
+        /* Fails the method calls written to the closed connection, their results can't arrive in a new session.
+         * Those whose method message is still waiting in the queue are kept, it is written once the session is back.
+         */
+        void fail_pending_methods();
+
+        /* Resubscribes to the active record sets, except those whose sub message is still waiting in the queue.
+         */
+        void replay_subscriptions();
+
         void on_message(client::message_ptr const& msg);
 
+        static message_type decode_message_type(nlohmann::json const& payload);
+
+        void on_method_result(std::string const& id, nlohmann::json const& result, nlohmann::json const& error);
+
+        void on_subscription_ready(std::string const& id);
+
+        void on_subscription_stopped(std::string const& id, nlohmann::json const& error);
+
         private:
+        boost::asio::io_service& _io_service;
         client::connection_ptr _conn;
         client _client;
+        std::string _url;
         std::string _session;
+        boost::asio::deadline_timer _reconnect_timer;
+        boost::posix_time::time_duration _reconnect_initial = boost::posix_time::seconds(1);
+        boost::posix_time::time_duration _reconnect_maximum = boost::posix_time::minutes(5);
+        unsigned int _reconnect_attempts = 0;
+        bool _reconnecting = false;
+        bool _established = false;
+        std::vector<std::string> _outbound;
+        std::unordered_set<std::string> _queued_subscriptions;
+        std::unordered_set<std::string> _queued_methods;
+        boost::asio::deadline_timer _flush_timer;
+        boost::posix_time::time_duration _flush_delay;
+        std::size_t _max_batch_size = 1024;
+        std::size_t _max_queued = 1024;
+        bool _flush_scheduled = false;
         connected_signal _connected_sig;
+        connected_signal _reconnected_sig;
         ready_signal _ready_sig;
-        method_result_signal _method_result_sig;
+        nosub_signal _nosub_sig;
+        std::unordered_map<std::string, pending_method> _pending_methods;
+        std::unordered_map<std::string, subscription> _subscriptions;
+        std::shared_ptr<void> _lifetime = std::make_shared<int>();
         method_updated_signal _method_updated_sig;
         document_added_signal _doc_added_sig;
         document_changed_signal _doc_changed_sig;
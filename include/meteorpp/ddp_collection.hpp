@@ -24,13 +24,20 @@
 #ifndef __meteorpp_ddp_collection_hpp__
 #define __meteorpp_ddp_collection_hpp__
 
+#include <unordered_set>
+
 #include <boost/bimap.hpp>
 
 #include "ddp.hpp"
 #include "collection.hpp"
+#include "memory_collection.hpp"
 
 namespace meteorpp {
-    class ddp_collection : public collection
+    /* Mirrors a DDP subscription into a local collection, collection_t being either the EJDB backed
+     * collection or the in-memory memory_collection.
+     */
+    template<typename collection_t>
+    class basic_ddp_collection : public collection_t
     {
         template<bool...> struct bool_pack;
         template<bool... bs>
@@ -54,34 +61,34 @@ namespace meteorpp {
         typedef boost::signals2::signal<void()> ready_signal;
 
         template<typename iterator_t, typename = typename std::enable_if<is_iterator<iterator_t>::value>::type>
-        ddp_collection(std::shared_ptr<ddp> const& ddp, std::string const& name, iterator_t begin, iterator_t end) throw(ejdb_exception, websocketpp::exception)
-            : collection(name), _name(name), _ddp(ddp)
+        basic_ddp_collection(std::shared_ptr<ddp> const& ddp, std::string const& name, iterator_t begin, iterator_t end) throw(std::runtime_error, websocketpp::exception)
+            : collection_t(name), _name(name), _ddp(ddp)
         {
             init_ddp_collection(name, nlohmann::json::array_t(begin, end));
         }
 
         template<typename... Args, typename = typename std::enable_if<are_all_convertible<nlohmann::json, Args...>::value>::type>
-        ddp_collection(std::shared_ptr<ddp> const& ddp, std::string const& name, Args&&... args) throw(ejdb_exception, websocketpp::exception)
-            : collection(name), _name(name), _ddp(ddp)
+        basic_ddp_collection(std::shared_ptr<ddp> const& ddp, std::string const& name, Args&&... args) throw(std::runtime_error, websocketpp::exception)
+            : collection_t(name), _name(name), _ddp(ddp)
         {
             init_ddp_collection(name, { std::forward<Args>(args)... });
         }
 
         template<typename iterator_t, typename = typename std::enable_if<is_iterator<iterator_t>::value>::type>
-        ddp_collection(std::shared_ptr<ddp> const& ddp, std::pair<std::string, std::string> const& name_pair, iterator_t begin, iterator_t end) throw(ejdb_exception, websocketpp::exception)
-            : collection(name_pair.first), _name(name_pair.first), _ddp(ddp)
+        basic_ddp_collection(std::shared_ptr<ddp> const& ddp, std::pair<std::string, std::string> const& name_pair, iterator_t begin, iterator_t end) throw(std::runtime_error, websocketpp::exception)
+            : collection_t(name_pair.first), _name(name_pair.first), _ddp(ddp)
         {
             init_ddp_collection(name_pair.second, nlohmann::json::array_t(begin, end));
         }
 
         template<typename... Args, typename = typename std::enable_if<are_all_convertible<nlohmann::json, Args...>::value>::type>
-        ddp_collection(std::shared_ptr<ddp> const& ddp, std::pair<std::string, std::string> const& name_pair, Args&&... args) throw(ejdb_exception, websocketpp::exception)
-            : collection(name_pair.first), _name(name_pair.first), _ddp(ddp)
+        basic_ddp_collection(std::shared_ptr<ddp> const& ddp, std::pair<std::string, std::string> const& name_pair, Args&&... args) throw(std::runtime_error, websocketpp::exception)
+            : collection_t(name_pair.first), _name(name_pair.first), _ddp(ddp)
         {
             init_ddp_collection(name_pair.second, { std::forward<Args>(args)... });
         }
 
-        virtual ~ddp_collection();
+        virtual ~basic_ddp_collection();
 
         virtual std::string insert(nlohmann::json::object_t const& document) throw(std::runtime_error);
 
@@ -91,10 +98,20 @@ namespace meteorpp {
 
         virtual int remove(nlohmann::json::object_t const& selector) throw(std::runtime_error);
 
+        virtual std::vector<std::string> insert_many(std::vector<nlohmann::json::object_t> const& documents) throw(std::runtime_error);
+
+        virtual int update_many(std::vector<std::pair<nlohmann::json::object_t, nlohmann::json::object_t>> const& updates) throw(std::runtime_error);
+
+        virtual int remove_many(std::vector<nlohmann::json::object_t> const& selectors) throw(std::runtime_error);
+
         void on_ready(ready_signal::slot_type const& slot);
 
         private:
-        void init_ddp_collection(std::string const& name, nlohmann::json::array_t const& params = nlohmann::json::array()) throw(websocketpp::exception);
+        void init_ddp_collection(std::string const& name, nlohmann::json::array_t const& params = nlohmann::json::array()) throw(std::runtime_error, websocketpp::exception);
+
+        /* Marks every local document as stale until the next initial batch confirms or updates it.
+         */
+        void mark_stale();
 
         void commit_insert(std::string const& id, nlohmann::json::object_t const& fields);
 
@@ -104,21 +121,33 @@ namespace meteorpp {
 
         void on_initial_batch(std::string const& subscription);
 
+        /* Stops pushing local changes and reconciles the local documents with the initial batch of the replayed subscription.
+         * The methods of the previous session are not waited for anymore, the server resends their documents.
+         */
+        void on_reconnected(std::string const& session);
+
         void on_document_added(std::string const& collection, std::string const& id, nlohmann::json::object_t const& fields);
 
         void on_document_changed(std::string const& collection, std::string const& id, nlohmann::json::object_t const& fields, std::vector<std::string> const& cleared);
 
         void on_document_removed(std::string const& collection, std::string const& id);
 
+        void merge_document(std::string const& id, nlohmann::json::object_t const& fields, std::vector<std::string> const& cleared);
+
         private:
         std::string _name;
         std::shared_ptr<ddp> _ddp;
         std::string _subscription;
         ready_signal _ready_sig;
         boost::bimap<std::string, std::string> _idle;
+        std::unordered_set<std::string> _stale;
         boost::signals2::connection _doc_insert_push;
         boost::signals2::connection _doc_update_push;
         boost::signals2::connection _doc_remove_push;
     };
+
+    typedef basic_ddp_collection<collection> ddp_collection;
+
+    typedef basic_ddp_collection<memory_collection> memory_ddp_collection;
 }
 #endif
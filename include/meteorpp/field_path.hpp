@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2015, Mario Flach. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef __meteorpp_field_path_hpp__
+#define __meteorpp_field_path_hpp__
+
+#include <nlohmann/json.hpp>
+
+namespace meteorpp {
+    /* A dotted path to a (possibly nested) document field, e.g. "profile.emails.0.address".
+     */
+    class field_path
+    {
+        public:
+        field_path(std::string const& path);
+
+        std::string const& str() const;
+
+        std::vector<std::string> const& segments() const;
+
+        /* Returns the value at this path, or null if the path does not exist.
+         */
+        nlohmann::json const* find(nlohmann::json::object_t const& document) const;
+
+        /* Returns the value at this path, creating missing intermediate objects if asked to.
+         */
+        nlohmann::json* find(nlohmann::json::object_t& document, bool create = false) const throw(std::invalid_argument);
+
+        /* Collects every value reachable through this path, descending into arrays the way MongoDB does.
+         */
+        void resolve(nlohmann::json::object_t const& document, std::vector<nlohmann::json const*>& values) const;
+
+        /* Removes the value at this path, returns false if it did not exist.
+         */
+        bool erase(nlohmann::json::object_t& document) const;
+
+        private:
+        void resolve(nlohmann::json const& value, std::size_t segment, std::vector<nlohmann::json const*>& values) const;
+
+        private:
+        std::string _path;
+        std::vector<std::string> _segments;
+    };
+}
+
+#endif
@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2015, Mario Flach. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef __meteorpp_live_aggregate_hpp__
+#define __meteorpp_live_aggregate_hpp__
+
+#include <set>
+
+#include "collection.hpp"
+#include "field_path.hpp"
+
+namespace meteorpp {
+    /* Keeps count, sum, min and max of a field over the documents matching a selector up to date,
+     * in total and grouped by the value of another field if asked to.
+     */
+    class live_aggregate : public live_query_router::observer
+    {
+        public:
+        typedef boost::signals2::signal<void()> updated_signal;
+
+        struct totals
+        {
+            /* Returns the smallest value of the field, or null if no document has it.
+             */
+            nlohmann::json min() const;
+
+            /* Returns the largest value of the field, or null if no document has it.
+             */
+            nlohmann::json max() const;
+
+            /* Returns the sum of the numeric values of the field, an integer unless some of them are floats.
+             * Integers are summed exactly and floats with a compensated sum, so that adding and removing values
+             * does not accumulate rounding errors.
+             */
+            nlohmann::json sum() const;
+
+            std::size_t count = 0;
+            std::int64_t integer_sum = 0;
+            std::size_t float_count = 0;
+            double float_sum = 0;
+            double compensation = 0;
+            std::multiset<nlohmann::json> values;
+        };
+
+        live_aggregate(nlohmann::json::object_t const& selector, std::string const& field, std::string const& group_by, std::shared_ptr<collection_base> const& collection) throw(std::runtime_error);
+
+        virtual ~live_aggregate();
+
+        totals const& total() const;
+
+        std::map<nlohmann::json, totals> const& groups() const;
+
+        boost::signals2::connection on_changed(updated_signal::slot_type const& slot);
+
+        private:
+        virtual void document_added(std::string const& id, nlohmann::json::object_t const& fields);
+
+        virtual void document_changed(std::string const& id, nlohmann::json::object_t const& before, nlohmann::json::object_t const& after);
+
+        virtual void document_removed(std::string const& id, nlohmann::json::object_t const& document);
+
+        /* Applies the changes of a committed batch and notifies once.
+         */
+        virtual void apply_batch(std::vector<live_query_router::change const*> const& changes);
+
+        /* The change handlers return whether the totals changed.
+         */
+        bool add_document(nlohmann::json::object_t const& document);
+
+        bool change_document(nlohmann::json::object_t const& before, nlohmann::json::object_t const& after);
+
+        bool remove_document(nlohmann::json::object_t const& document);
+
+        void add(nlohmann::json::object_t const& document);
+
+        void remove(nlohmann::json::object_t const& document);
+
+        private:
+        field_path _field;
+        std::unique_ptr<field_path> _group_by;
+        totals _total;
+        std::map<nlohmann::json, totals> _groups;
+        updated_signal _updated_sig;
+        std::shared_ptr<collection_base> _coll;
+        selector::predicate _matcher;
+    };
+}
+
+#endif
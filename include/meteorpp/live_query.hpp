@@ -24,45 +24,163 @@
 #ifndef __meteorpp_live_query_hpp__
 #define __meteorpp_live_query_hpp__
 
+#include <set>
+
+#include <boost/asio/deadline_timer.hpp>
+#include <boost/asio/io_service.hpp>
+#include <boost/range/any_range.hpp>
+
 #include "collection.hpp"
+#include "persistent_sequence.hpp"
 
 namespace meteorpp {
+    class live_query_multiplexer;
+
+    /* Tracks the documents matching a selector. Live queries with identical selectors and options share their
+     * results and matching work, each with its own callbacks.
+     */
     class live_query
     {
+        friend class live_query_multiplexer;
+
         public:
+        /* The net effect of the changes notified by one on_changed, to be applied as removed, added then changed.
+         * Changed fields are dotted paths, which never overlap within a document.
+         */
+        struct change_set
+        {
+            bool empty() const;
+
+            std::map<std::string, nlohmann::json::object_t> added;
+            std::map<std::string, std::pair<nlohmann::json::object_t, std::vector<std::string>>> changed;
+            std::set<std::string> removed;
+        };
+
+        /* An immutable version of the results, safe to read from any thread while the live query keeps changing.
+         * Versions share their documents and most of their sequence nodes, each change copies O(log n) of them.
+         */
+        struct snapshot
+        {
+            nlohmann::json data() const;
+
+            std::uint64_t version;
+            persistent_sequence documents;
+        };
+
+        /* A forward range over the results in order, referring to the documents rather than copying them.
+         */
+        typedef boost::any_range<nlohmann::json::object_t const, boost::forward_traversal_tag, nlohmann::json::object_t const&, std::ptrdiff_t> document_range;
+
         typedef boost::signals2::signal<void()> updated_signal;
+        typedef boost::signals2::signal<void(change_set const& changes)> changes_signal;
+        typedef boost::signals2::signal<void(std::string const& id, nlohmann::json::object_t const& fields, std::string const& before)> document_added_before_signal;
+        typedef boost::signals2::signal<void(std::string const& id, std::string const& before)> document_moved_before_signal;
+        typedef boost::signals2::signal<void(std::string const& id, nlohmann::json::object_t const& fields, std::size_t index)> document_added_at_signal;
+        typedef boost::signals2::signal<void(std::string const& id, nlohmann::json::object_t const& fields, std::vector<std::string> const& cleared, std::size_t index)> document_changed_at_signal;
+        typedef boost::signals2::signal<void(std::string const& id, std::size_t from, std::size_t to)> document_moved_to_signal;
+        typedef boost::signals2::signal<void(std::string const& id, std::size_t index)> document_removed_at_signal;
 
-        live_query(nlohmann::json::object_t const& selector, std::shared_ptr<collection> const& collection) throw(std::runtime_error);
+        live_query(nlohmann::json::object_t const& selector, std::shared_ptr<collection_base> const& collection) throw(std::runtime_error);
+
+        /* Tracks the documents matching the selector in the given sort order, keeping only the first options.limit ones if set.
+         */
+        live_query(nlohmann::json::object_t const& selector, find_options const& options, std::shared_ptr<collection_base> const& collection) throw(std::runtime_error);
 
         virtual ~live_query();
 
+        /* Returns the matching documents as a JSON array. It is rebuilt on the first call after every change, which
+         * copies all the results, so prefer documents() to read them.
+         */
         nlohmann::json const& data() const;
 
+        /* Returns the matching documents in order without copying them. The range is invalidated by the next change
+         * to the collection.
+         */
+        document_range documents() const;
+
+        std::size_t size() const;
+
+        /* Returns the matching document with the given id, or null if there is none.
+         */
+        nlohmann::json::object_t const* find(std::string const& id) const;
+
+        /* Returns the latest version of the results published by the thread writing to the collection.
+         * Unlike data(), it may be called from any thread as long as the live query is alive.
+         */
+        std::shared_ptr<snapshot const> current_snapshot() const;
+
+        /* Defers on_changed and on_changes to the given io_service, so that they fire once for all the changes
+         * made until it runs the next handlers, or until the time window elapsed if one is given.
+         */
+        void coalesce(boost::asio::io_service& io_service, boost::posix_time::time_duration const& window = boost::posix_time::time_duration());
+
         boost::signals2::connection on_changed(updated_signal::slot_type const& slot);
 
-        boost::signals2::connection on_document_added(collection::document_added_signal::slot_type const& slot);
+        boost::signals2::connection on_changes(changes_signal::slot_type const& slot);
+
+        boost::signals2::connection on_document_added(collection_base::document_added_signal::slot_type const& slot);
+
+        boost::signals2::connection on_document_changed(collection_base::document_changed_signal::slot_type const& slot);
+
+        boost::signals2::connection on_document_removed(collection_base::document_removed_signal::slot_type const& slot);
+
+        /* Notifies added documents along with the id of the document they precede, or an empty id at the end of the results.
+         */
+        boost::signals2::connection on_document_added_before(document_added_before_signal::slot_type const& slot);
 
-        boost::signals2::connection on_document_changed(collection::document_changed_signal::slot_type const& slot);
+        /* Notifies documents whose position in a sorted live query changed, along with the id of the document they now precede.
+         */
+        boost::signals2::connection on_document_moved_before(document_moved_before_signal::slot_type const& slot);
 
-        boost::signals2::connection on_document_removed(collection::document_removed_signal::slot_type const& slot);
+        /* Notifies added documents along with the index they were inserted at.
+         */
+        boost::signals2::connection on_document_added_at(document_added_at_signal::slot_type const& slot);
+
+        /* Notifies changed documents along with their index, before any move the change causes.
+         */
+        boost::signals2::connection on_document_changed_at(document_changed_at_signal::slot_type const& slot);
+
+        /* Notifies documents moved from one index to another, the latter counted once the document left the former.
+         */
+        boost::signals2::connection on_document_moved_to(document_moved_to_signal::slot_type const& slot);
+
+        /* Notifies removed documents along with the index they had.
+         */
+        boost::signals2::connection on_document_removed_at(document_removed_at_signal::slot_type const& slot);
 
         private:
-        void document_added(std::string const& id, nlohmann::json::object_t const& fields);
+        void document_added(std::string const& id, nlohmann::json::object_t const& fields, std::string const& before, std::size_t index);
+
+        void document_changed(std::string const& id, nlohmann::json::object_t const& fields, std::vector<std::string> const& cleared, std::size_t index);
+
+        void document_moved(std::string const& id, std::string const& before, std::size_t from, std::size_t to);
 
-        void document_changed(std::string const& id, nlohmann::json::object_t const& before, nlohmann::json::object_t const& after);
+        void document_removed(std::string const& id, std::size_t index);
 
-        void document_removed(std::string const& id, nlohmann::json::object_t const& document);
+        void notify_updated();
 
-        bool match(nlohmann::json::object_t const& document);
+        void flush();
 
         private:
-        nlohmann::json _results;
+        std::shared_ptr<live_query_multiplexer> _multiplexer;
+        std::uint64_t _handle;
+        change_set _changes;
+        boost::asio::io_service* _io_service = nullptr;
+        boost::posix_time::time_duration _window;
+        std::unique_ptr<boost::asio::deadline_timer> _timer;
+        bool _flush_scheduled = false;
+        std::shared_ptr<void> _lifetime = std::make_shared<int>();
         updated_signal _updated_sig;
-        collection::document_added_signal _doc_added_sig;
-        collection::document_changed_signal _doc_changed_sig;
-        collection::document_removed_signal _doc_removed_sig;
-        std::shared_ptr<bson> _selector;
-        std::shared_ptr<collection> _coll;
+        changes_signal _changes_sig;
+        collection_base::document_added_signal _doc_added_sig;
+        collection_base::document_changed_signal _doc_changed_sig;
+        collection_base::document_removed_signal _doc_removed_sig;
+        document_added_before_signal _doc_added_before_sig;
+        document_moved_before_signal _doc_moved_before_sig;
+        document_added_at_signal _doc_added_at_sig;
+        document_changed_at_signal _doc_changed_at_sig;
+        document_moved_to_signal _doc_moved_to_sig;
+        document_removed_at_signal _doc_removed_at_sig;
     };
 }
 
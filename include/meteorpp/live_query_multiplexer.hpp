@@ -0,0 +1,185 @@
+/*
+ * Copyright (c) 2015, Mario Flach. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef __meteorpp_live_query_multiplexer_hpp__
+#define __meteorpp_live_query_multiplexer_hpp__
+
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+#include <boost/multi_index/identity.hpp>
+#include <boost/multi_index/ranked_index.hpp>
+#include <boost/multi_index_container.hpp>
+
+#include "live_query.hpp"
+#include "sort_order.hpp"
+
+namespace meteorpp {
+    /* The results of one tracked query, shared by all the live queries tracking the same selector and options.
+     */
+    class live_query_multiplexer : public live_query_router::observer, public std::enable_shared_from_this<live_query_multiplexer>
+    {
+        friend class live_query;
+
+        public:
+        live_query_multiplexer(std::string const& key, nlohmann::json::object_t const& selector, find_options const& options, std::shared_ptr<collection_base> const& collection) throw(std::runtime_error);
+
+        virtual ~live_query_multiplexer();
+
+        nlohmann::json const& data() const;
+
+        live_query::document_range documents() const;
+
+        std::size_t size() const;
+
+        nlohmann::json::object_t const* find(std::string const& id) const;
+
+        std::shared_ptr<live_query::snapshot const> current_snapshot() const;
+
+        /* Returns the key identifying the selector and options, equal for identical queries.
+         */
+        static std::string key(nlohmann::json::object_t const& selector, find_options const& options);
+
+        private:
+        struct result
+        {
+            std::shared_ptr<nlohmann::json::object_t const> document;
+            std::uint64_t sequence;
+        };
+
+        typedef std::list<result> result_list;
+
+        static nlohmann::json::object_t const& result_document(result const& r);
+
+        /* Orders results by the sort specification and then by id, or by arrival when there is none.
+         */
+        struct result_order
+        {
+            bool operator()(result_list::iterator const& a, result_list::iterator const& b) const;
+
+            bool precedes(nlohmann::json::object_t const& a, nlohmann::json::object_t const& b) const;
+
+            sort_order order;
+        };
+
+        typedef boost::multi_index_container<result_list::iterator, boost::multi_index::indexed_by<boost::multi_index::ranked_unique<boost::multi_index::identity<result_list::iterator>, result_order>>> result_ranking;
+
+        std::uint64_t add_handle(live_query* handle);
+
+        void remove_handle(std::uint64_t handle);
+
+        virtual void document_added(std::string const& id, nlohmann::json::object_t const& fields);
+
+        virtual void document_changed(std::string const& id, nlohmann::json::object_t const& before, nlohmann::json::object_t const& after);
+
+        virtual void document_removed(std::string const& id, nlohmann::json::object_t const& document);
+
+        /* Applies the changes of a committed batch and notifies the live queries once.
+         * Refills are deferred to the end of the batch, once the collection and the results agree again.
+         */
+        virtual void apply_batch(std::vector<live_query_router::change const*> const& changes);
+
+        /* The change handlers return whether the results changed.
+         */
+        bool add_document(std::string const& id, std::shared_ptr<nlohmann::json::object_t const> const& document);
+
+        bool change_document(std::string const& id, nlohmann::json::object_t const& before, std::shared_ptr<nlohmann::json::object_t const> const& after);
+
+        bool remove_document(std::string const& id);
+
+        void notify_updated();
+
+        /* Hands the current results over to current_snapshot(), which wraps them into a new snapshot only once
+         * it is called.
+         */
+        void publish();
+
+        bool match(nlohmann::json::object_t const& document);
+
+        /* Adds a matching document unless the results are full and it sorts after the last one, which is evicted otherwise.
+         * While a refill is deferred, only documents sorting before the last result are added, the refill brings the others.
+         */
+        bool admit(std::string const& id, std::shared_ptr<nlohmann::json::object_t const> const& document);
+
+        /* Pulls the next matching documents from the collection after results of a full live query left.
+         * Within a batch, it only marks the refill as pending.
+         */
+        void refill();
+
+        /* Returns a selector for the matching documents which sort after the given result by the sort keys and then
+         * by id. Each sort key is assumed to hold values of a single type, since $gt and $lt do not compare across
+         * types the way sorting does. Without a sort, or if the collection does not select ranges in sort order,
+         * it excludes the results up to the given one instead, which the documents sorting before it all are.
+         */
+        nlohmann::json::object_t following(result_list::iterator last) const;
+
+        result_list::iterator insert_result(std::string const& id, std::shared_ptr<nlohmann::json::object_t const> const& document);
+
+        /* Inserts a result without updating the sequence backing the snapshots.
+         */
+        result_list::iterator place_result(std::string const& id, std::shared_ptr<nlohmann::json::object_t const> const& document);
+
+        /* Removes a result and returns the index it had.
+         */
+        std::size_t erase_result(std::string const& id);
+
+        std::size_t index_of(result_list::iterator it) const;
+
+        std::string next_id(result_list::iterator it) const;
+
+        void for_each_handle(std::function<void(live_query&)> const& notify);
+
+        void emit_added(std::string const& id, result_list::iterator it);
+
+        void emit_changed(std::string const& id, nlohmann::json::object_t const& before, nlohmann::json::object_t const& after, std::size_t index);
+
+        void emit_moved(std::string const& id, std::string const& before, std::size_t from, std::size_t to);
+
+        void emit_removed(std::string const& id, std::size_t index);
+
+        private:
+        std::string _key;
+        nlohmann::json::object_t _selector;
+        find_options _options;
+        result_list _results;
+        std::unordered_map<std::string, result_list::iterator> _result_index;
+        result_ranking _result_order;
+        std::uint64_t _next_sequence = 0;
+        bool _batching = false;
+        bool _refill_pending = false;
+        mutable nlohmann::json _data;
+        mutable bool _data_valid = false;
+        persistent_sequence _sequence;
+        mutable std::mutex _snapshot_mutex;
+        persistent_sequence _published;
+        mutable bool _publish_pending = false;
+        mutable std::shared_ptr<live_query::snapshot const> _snapshot;
+        std::uint64_t _next_handle = 0;
+        std::map<std::uint64_t, live_query*> _handles;
+        std::shared_ptr<collection_base> _coll;
+        selector::predicate _matcher;
+    };
+}
+
+#endif
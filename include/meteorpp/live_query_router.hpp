@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2015, Mario Flach. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef __meteorpp_live_query_router_hpp__
+#define __meteorpp_live_query_router_hpp__
+
+#include <map>
+#include <memory>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+namespace meteorpp {
+    /* Delivers collection changes only to the live queries whose selectors could match the changed documents.
+     *
+     * Live queries are indexed by the first top-level field their selector compares by value ($eq, $in) or,
+     * failing that, by range ($gt, $gte, $lt, $lte, $bt). Other live queries receive every change. Live aggregates are
+     * routed the same way.
+     *
+     * Ranges bounded on one side only are kept sorted by their bound, so a write only visits the ranges containing
+     * its value. Ranges bounded on both sides are sorted by their lower bound: a write visits every one of them that
+     * starts below its value and checks the upper bound, which is linear in the number of such ranges.
+     *
+     * Between begin_batch() and commit_batch() changes are collected and then handed to each live query they
+     * concern in one call, so that a bulk write updates every live query once instead of once per document.
+     */
+    class live_query_router
+    {
+        public:
+        /* A change collected during a batch. The documents include their _id and are shared by all the live
+         * queries receiving the change; before is null for additions and after is null for removals.
+         */
+        struct change
+        {
+            enum class kind { added, changed, removed };
+
+            kind type;
+            std::string id;
+            std::shared_ptr<nlohmann::json::object_t const> before;
+            std::shared_ptr<nlohmann::json::object_t const> after;
+        };
+
+        /* Receives the changes routed to a selector, one at a time or as a committed batch.
+         */
+        class observer
+        {
+            public:
+            virtual ~observer() {}
+
+            virtual void document_added(std::string const& id, nlohmann::json::object_t const& fields) = 0;
+
+            virtual void document_changed(std::string const& id, nlohmann::json::object_t const& before, nlohmann::json::object_t const& after) = 0;
+
+            virtual void document_removed(std::string const& id, nlohmann::json::object_t const& document) = 0;
+
+            virtual void apply_batch(std::vector<change const*> const& changes) = 0;
+        };
+
+        void add(observer* query, nlohmann::json::object_t const& selector);
+
+        void remove(observer* query);
+
+        void document_added(std::string const& id, nlohmann::json::object_t const& fields);
+
+        void document_changed(std::string const& id, nlohmann::json::object_t const& before, nlohmann::json::object_t const& after);
+
+        void document_removed(std::string const& id, nlohmann::json::object_t const& document);
+
+        void begin_batch();
+
+        void commit_batch();
+
+        private:
+        struct route
+        {
+            observer* query;
+            bool active;
+            std::string field;
+            std::vector<nlohmann::json> keys;
+            nlohmann::json lower;
+            nlohmann::json upper;
+            bool lower_inclusive;
+            bool upper_inclusive;
+        };
+
+        struct range_index
+        {
+            std::multimap<nlohmann::json, std::uint64_t> lower_bounded;
+            std::multimap<nlohmann::json, std::uint64_t> upper_bounded;
+            std::multimap<nlohmann::json, std::uint64_t> bounded;
+
+            bool empty() const;
+        };
+
+        /* Returns the routes sorted by the same bounds as the given one, and the bound they are sorted by.
+         */
+        static std::multimap<nlohmann::json, std::uint64_t>& range_routes(range_index& index, route const& r, nlohmann::json const*& key);
+
+        void collect(nlohmann::json::object_t const& document, std::set<std::uint64_t>& routes) const;
+
+        std::vector<std::shared_ptr<route>> resolve(std::set<std::uint64_t> const& routes) const;
+
+        static bool in_range(route const& r, nlohmann::json const& value);
+
+        void record(change&& c, std::set<std::uint64_t> const& routes);
+
+        private:
+        std::uint64_t _next_route = 0;
+        std::map<std::uint64_t, std::shared_ptr<route>> _routes;
+        std::unordered_map<observer*, std::uint64_t> _query_routes;
+        std::set<std::uint64_t> _broadcast;
+        std::map<std::string, std::map<nlohmann::json, std::set<std::uint64_t>>> _equalities;
+        std::map<std::string, range_index> _ranges;
+        bool _batching = false;
+        std::vector<change> _batch;
+        std::map<std::uint64_t, std::vector<std::size_t>> _batch_routes;
+    };
+}
+
+#endif
@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2015, Mario Flach. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef __meteorpp_memory_collection_hpp__
+#define __meteorpp_memory_collection_hpp__
+
+#include <list>
+#include <map>
+#include <set>
+#include <unordered_map>
+
+#include "collection.hpp"
+
+namespace meteorpp {
+    /* A collection which keeps its documents in process memory, hashed by _id, without touching EJDB.
+     */
+    class memory_collection : public collection_base
+    {
+        public:
+        memory_collection(std::string const& name) throw(std::runtime_error);
+
+        virtual ~memory_collection();
+
+        std::string const& name() const;
+
+        virtual int count(nlohmann::json::object_t const& selector = nlohmann::json::object()) throw(std::runtime_error);
+
+        virtual std::vector<nlohmann::json::object_t> find(nlohmann::json::object_t const& selector = nlohmann::json::object(), find_options const& options = find_options()) throw(std::runtime_error);
+
+        virtual nlohmann::json::object_t find_one(nlohmann::json::object_t const& selector = nlohmann::json::object(), find_options const& options = find_options()) throw(std::runtime_error);
+
+        virtual std::string insert(nlohmann::json::object_t const& document) throw(std::runtime_error);
+
+        virtual int update(nlohmann::json::object_t const& selector, nlohmann::json::object_t const& modifier) throw(std::runtime_error);
+
+        virtual int upsert(nlohmann::json::object_t const& selector, nlohmann::json::object_t const& modifier) throw(std::runtime_error);
+
+        virtual int remove(nlohmann::json::object_t const& selector) throw(std::runtime_error);
+
+        virtual std::vector<std::string> insert_many(std::vector<nlohmann::json::object_t> const& documents) throw(std::runtime_error);
+
+        virtual int update_many(std::vector<std::pair<nlohmann::json::object_t, nlohmann::json::object_t>> const& updates) throw(std::runtime_error);
+
+        virtual int remove_many(std::vector<nlohmann::json::object_t> const& selectors) throw(std::runtime_error);
+
+        /* Maintains an equality index on a field path, used by selectors matching that field by value or $in.
+         */
+        void ensure_index(std::string const& path) throw(std::runtime_error);
+
+        void drop_index(std::string const& path);
+
+        std::vector<std::string> indexes() const;
+
+        protected:
+        /* The documents removed by a write, each with the id of the document which followed it (empty if it was
+         * last), in order of removal, so that rolling back restores the original order.
+         */
+        typedef std::vector<std::pair<std::string, std::string>> removal_log;
+
+        std::vector<nlohmann::json::object_t*> select(nlohmann::json::object_t const& selector, std::size_t limit = 0) throw(std::runtime_error);
+
+        bool candidates(nlohmann::json::object_t const& selector, std::vector<std::string>& ids) const;
+
+        std::string store(nlohmann::json::object_t document) throw(std::runtime_error);
+
+        int modify(nlohmann::json::object_t const& selector, nlohmann::json::object_t const& modifier, changeset& changes) throw(std::runtime_error);
+
+        int erase(nlohmann::json::object_t const& selector, changeset& changes, removal_log& removals) throw(std::runtime_error);
+
+        void rollback(changeset const& changes, removal_log const& removals = removal_log());
+
+        void index_document(std::string const& id, nlohmann::json::object_t const& document);
+
+        void unindex_document(std::string const& id, nlohmann::json::object_t const& document);
+
+        static std::string generate_id();
+
+        private:
+        typedef std::list<nlohmann::json::object_t> document_list;
+        typedef std::set<std::pair<nlohmann::json, std::string>> field_index;
+
+        std::string _name;
+        document_list _documents;
+        std::unordered_map<std::string, document_list::iterator> _ids;
+        std::map<std::string, field_index> _indexes;
+    };
+}
+
+#endif
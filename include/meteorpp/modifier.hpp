@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2015, Mario Flach. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef __meteorpp_modifier_hpp__
+#define __meteorpp_modifier_hpp__
+
+#include <nlohmann/json.hpp>
+
+namespace meteorpp {
+    /* A Mongo-style modifier ($set, $unset, $inc, $push, ...) or replacement document applied to JSON documents directly.
+     */
+    class modifier
+    {
+        public:
+        /* Validates the given modifier, throws std::invalid_argument on unsupported operators.
+         */
+        modifier(nlohmann::json::object_t const& modifier) throw(std::invalid_argument);
+
+        /* Applies the modifier in place, the document's _id is left untouched.
+         */
+        void apply(nlohmann::json::object_t& document) const throw(std::invalid_argument);
+
+        private:
+        void apply(std::string const& op, std::string const& path, nlohmann::json const& arg, nlohmann::json::object_t& document) const throw(std::invalid_argument);
+
+        private:
+        nlohmann::json::object_t _modifier;
+        bool _replacement;
+    };
+}
+
+#endif
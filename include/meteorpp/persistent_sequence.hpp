@@ -0,0 +1,126 @@
+/*
+ * Copyright (c) 2015, Mario Flach. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef __meteorpp_persistent_sequence_hpp__
+#define __meteorpp_persistent_sequence_hpp__
+
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+namespace meteorpp {
+    /* An immutable sequence of shared documents, kept as a treap ordered by position. Inserting, erasing or replacing
+     * an element returns a new sequence which shares all but O(log n) nodes with the original one.
+     */
+    class persistent_sequence
+    {
+        struct node;
+
+        typedef std::shared_ptr<node const> node_ptr;
+
+        public:
+        typedef std::shared_ptr<nlohmann::json::object_t const> value_type;
+
+        /* Iterates over the elements in order, the sequence must outlive its iterators.
+         */
+        class iterator : public std::iterator<std::forward_iterator_tag, value_type const>
+        {
+            friend class persistent_sequence;
+
+            public:
+            iterator();
+
+            value_type const& operator*() const;
+
+            value_type const* operator->() const;
+
+            iterator& operator++();
+
+            iterator operator++(int);
+
+            bool operator==(iterator const& other) const;
+
+            bool operator!=(iterator const& other) const;
+
+            private:
+            explicit iterator(node const* root);
+
+            void descend(node const* n);
+
+            private:
+            std::vector<node const*> _path;
+        };
+
+        persistent_sequence();
+
+        /* Builds a balanced sequence of the given elements in linear time.
+         */
+        explicit persistent_sequence(std::vector<value_type> const& elements);
+
+        std::size_t size() const;
+
+        bool empty() const;
+
+        value_type const& at(std::size_t index) const throw(std::out_of_range);
+
+        value_type const& front() const throw(std::out_of_range);
+
+        value_type const& back() const throw(std::out_of_range);
+
+        iterator begin() const;
+
+        iterator end() const;
+
+        persistent_sequence insert(std::size_t index, value_type const& value) const throw(std::out_of_range);
+
+        persistent_sequence erase(std::size_t index) const throw(std::out_of_range);
+
+        persistent_sequence replace(std::size_t index, value_type const& value) const throw(std::out_of_range);
+
+        private:
+        explicit persistent_sequence(node_ptr const& root);
+
+        static node_ptr join(value_type const& value, node_ptr const& left, node_ptr const& right, std::uint64_t priority);
+
+        /* Splits the elements before index from the others.
+         */
+        static std::pair<node_ptr, node_ptr> split(node_ptr const& n, std::size_t index);
+
+        static node_ptr merge(node_ptr const& left, node_ptr const& right);
+
+        static node_ptr insert_node(node_ptr const& n, std::size_t index, value_type const& value, std::uint64_t priority);
+
+        static node_ptr erase_node(node_ptr const& n, std::size_t index);
+
+        static node_ptr replace_node(node_ptr const& n, std::size_t index, value_type const& value);
+
+        private:
+        node_ptr _root;
+    };
+}
+
+#endif
@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2015, Mario Flach. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef __meteorpp_prepared_query_hpp__
+#define __meteorpp_prepared_query_hpp__
+
+#include "collection.hpp"
+
+namespace meteorpp {
+    /* A selector compiled once against a collection which can be executed many times.
+     */
+    class prepared_query
+    {
+        friend class collection;
+
+        public:
+        virtual ~prepared_query();
+
+        int count() throw(ejdb_exception);
+
+        std::vector<nlohmann::json::object_t> find() throw(ejdb_exception);
+
+        nlohmann::json::object_t find_one() throw(ejdb_exception);
+
+        cursor find_cursor() throw(ejdb_exception);
+
+        private:
+        prepared_query(std::shared_ptr<collection> const& collection, std::shared_ptr<EJQ> const& query);
+
+        private:
+        std::shared_ptr<collection> _coll;
+        std::shared_ptr<EJQ> _query;
+    };
+}
+
+#endif
@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2015, Mario Flach. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef __meteorpp_selector_hpp__
+#define __meteorpp_selector_hpp__
+
+#include <functional>
+
+#include <nlohmann/json.hpp>
+
+namespace meteorpp {
+    /* A Mongo-style selector compiled into a predicate which evaluates JSON documents directly.
+     */
+    class selector
+    {
+        public:
+        typedef std::function<bool(nlohmann::json::object_t const& document)> predicate;
+
+        /* Compiles the given selector, throws std::invalid_argument on unsupported operators or malformed arguments.
+         */
+        selector(nlohmann::json::object_t const& selector = nlohmann::json::object()) throw(std::invalid_argument);
+
+        bool match(nlohmann::json::object_t const& document) const;
+
+        bool operator()(nlohmann::json::object_t const& document) const;
+
+        private:
+        predicate _predicate;
+    };
+}
+
+#endif
@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2015, Mario Flach. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef __meteorpp_sort_order_hpp__
+#define __meteorpp_sort_order_hpp__
+
+#include "field_path.hpp"
+
+namespace meteorpp {
+    /* A Mongo-style sort specification, e.g. {{ "score", -1 }, { "name", 1 }}, compiled into an ordering of JSON documents.
+     */
+    class sort_order
+    {
+        public:
+        /* The sort keys with their directions (1 ascending, -1 descending), most significant first.
+         */
+        typedef std::vector<std::pair<std::string, int>> specification;
+
+        sort_order(specification const& keys = specification());
+
+        bool empty() const;
+
+        /* Returns true if a sorts before b, documents with equal sort keys are equivalent.
+         */
+        bool operator()(nlohmann::json::object_t const& a, nlohmann::json::object_t const& b) const;
+
+        private:
+        std::vector<std::pair<field_path, bool>> _keys;
+    };
+}
+
+#endif
@@ -0,0 +1,171 @@
+/*
+ * Copyright (c) 2015, Mario Flach. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include <climits>
+
+#include "../include/meteorpp/bson.hpp"
+
+namespace meteorpp {
+    namespace {
+        void append_value(bson* out, char const* key, nlohmann::json const& value)
+        {
+            switch(value.type()) {
+                case nlohmann::json::value_t::null:
+                case nlohmann::json::value_t::discarded:
+                    bson_append_null(out, key);
+                    break;
+                case nlohmann::json::value_t::boolean:
+                    bson_append_bool(out, key, value.get<bool>());
+                    break;
+                case nlohmann::json::value_t::number_integer: {
+                    auto const number = value.get<std::int64_t>();
+                    if(number >= INT_MIN && number <= INT_MAX) {
+                        bson_append_int(out, key, static_cast<int>(number));
+                    } else {
+                        bson_append_long(out, key, number);
+                    }
+                    break;
+                }
+                case nlohmann::json::value_t::number_unsigned: {
+                    auto const number = value.get<std::uint64_t>();
+                    if(number <= INT_MAX) {
+                        bson_append_int(out, key, static_cast<int>(number));
+                    } else {
+                        bson_append_long(out, key, static_cast<std::int64_t>(number));
+                    }
+                    break;
+                }
+                case nlohmann::json::value_t::number_float:
+                    bson_append_double(out, key, value.get<double>());
+                    break;
+                case nlohmann::json::value_t::string: {
+                    auto const& string = value.get_ref<std::string const&>();
+                    bson_append_string_n(out, key, string.data(), string.size());
+                    break;
+                }
+                case nlohmann::json::value_t::object:
+                    bson_append_start_object(out, key);
+                    append_to_bson(out, value);
+                    bson_append_finish_object(out);
+                    break;
+                case nlohmann::json::value_t::array:
+                    bson_append_start_array(out, key);
+                    append_to_bson(out, value);
+                    bson_append_finish_array(out);
+                    break;
+                default:
+                    throw std::invalid_argument("couldn't convert JSON value to BSON, unsupported type");
+            }
+        }
+
+        nlohmann::json read_value(bson_iterator const* it, bson_type type);
+
+        void read_fields(bson_iterator* it, nlohmann::json& out)
+        {
+            bson_type type;
+            while((type = bson_iterator_next(it)) != BSON_EOO) {
+                if(out.is_array()) {
+                    out.push_back(read_value(it, type));
+                } else {
+                    out.emplace(bson_iterator_key(it), read_value(it, type));
+                }
+            }
+        }
+
+        nlohmann::json read_value(bson_iterator const* it, bson_type type)
+        {
+            switch(type) {
+                case BSON_DOUBLE:
+                    return bson_iterator_double(it);
+                case BSON_STRING:
+                case BSON_SYMBOL:
+                case BSON_CODE:
+                    return std::string(bson_iterator_string(it), bson_iterator_string_len(it) - 1);
+                case BSON_OBJECT:
+                case BSON_ARRAY: {
+                    bson_iterator sub;
+                    bson_iterator_subiterator(it, &sub);
+                    nlohmann::json value = type == BSON_ARRAY ? nlohmann::json::array() : nlohmann::json::object();
+                    read_fields(&sub, value);
+                    return value;
+                }
+                case BSON_OID: {
+                    std::string id(24, '\0');
+                    bson_oid_to_string(bson_iterator_oid(it), &id[0]);
+                    return id;
+                }
+                case BSON_BOOL:
+                    return static_cast<bool>(bson_iterator_bool(it));
+                case BSON_INT:
+                    return bson_iterator_int(it);
+                case BSON_LONG:
+                case BSON_TIMESTAMP:
+                    return bson_iterator_long(it);
+                case BSON_DATE:
+                    return bson_iterator_date(it);
+                default:
+                    return nullptr;
+            }
+        }
+    }
+
+    void append_to_bson(bson* out, nlohmann::json const& value) throw(std::invalid_argument)
+    {
+        if(value.is_object()) {
+            for(auto it = value.begin(); it != value.end(); ++it) {
+                append_value(out, it.key().c_str(), it.value());
+            }
+        } else if(value.is_array()) {
+            for(std::size_t i = 0; i < value.size(); ++i) {
+                append_value(out, std::to_string(i).c_str(), value[i]);
+            }
+        } else {
+            throw std::invalid_argument("couldn't convert JSON value to BSON, expected object or array");
+        }
+    }
+
+    void append_to_bson(bson* out, char const* key, nlohmann::json const& value) throw(std::invalid_argument)
+    {
+        append_value(out, key, value);
+    }
+
+    std::shared_ptr<bson> json_to_bson(nlohmann::json const& value) throw(std::invalid_argument)
+    {
+        std::shared_ptr<bson> out(bson_create(), bson_del);
+        bson_init(out.get());
+        append_to_bson(out.get(), value);
+        if(bson_finish(out.get()) != BSON_OK) {
+            throw std::invalid_argument("couldn't convert JSON value to BSON, invalid document");
+        }
+        return out;
+    }
+
+    nlohmann::json bson_to_json(char const* data)
+    {
+        nlohmann::json value = nlohmann::json::object();
+        bson_iterator it;
+        bson_iterator_from_buffer(&it, data);
+        read_fields(&it, value);
+        return value;
+    }
+}
@@ -23,21 +23,40 @@
 
 #include <mutex>
 
-#include <boost/lexical_cast.hpp>
-#include <boost/algorithm/hex.hpp>
-
 #include <ejdb/ejdb.h>
 #include <ejdb/ejdb_private.h>
 
+#include "../include/meteorpp/bson.hpp"
 #include "../include/meteorpp/collection.hpp"
 #include "../include/meteorpp/live_query.hpp"
+#include "../include/meteorpp/prepared_query.hpp"
 
 
 std::weak_ptr<EJDB> db;
 
+std::string db_path = "meteorpp.db";
+
+meteorpp::collection::open_mode db_mode = meteorpp::collection::open_mode::truncate;
+
 std::once_flag bson_oid_setup_flag;
 
 namespace meteorpp {
+    namespace {
+        int index_flags(collection::index_type type)
+        {
+            switch(type) {
+                case collection::index_type::istring:
+                    return JBIDXISTR;
+                case collection::index_type::number:
+                    return JBIDXNUM;
+                case collection::index_type::array:
+                    return JBIDXARR;
+                default:
+                    return JBIDXSTR;
+            }
+        }
+    }
+
     ejdb_exception::ejdb_exception(std::string const& error_message, int error_code)
         : std::runtime_error(error_message), _error_code(error_code)
     {
@@ -59,6 +78,7 @@ namespace meteorpp {
     }
 
     collection::collection(std::string const& name) throw(ejdb_exception)
+        : _name(name)
     {
         if(name.empty()) {
             throw ejdb_exception(JBEINVALIDCOLNAME);
@@ -70,7 +90,7 @@ namespace meteorpp {
         }));
         if(!(_db = db.lock())) {
             _db = std::shared_ptr<EJDB>(ejdbnew(), ejdbdel);
-            if(!ejdbopen(_db.get(), "meteorpp.db", JBOWRITER | JBOCREAT | JBOTRUNC)) {
+            if(!ejdbopen(_db.get(), db_path.c_str(), JBOWRITER | JBOCREAT | (db_mode == open_mode::truncate ? JBOTRUNC : 0))) {
                 throw_last_ejdb_exception();
             }
             db = _db;
@@ -87,9 +107,10 @@ namespace meteorpp {
     {
     }
 
-    std::shared_ptr<live_query> collection::track(nlohmann::json::object_t const& selector) throw(std::bad_weak_ptr)
+    void collection::set_database(std::string const& path, open_mode mode)
     {
-        return std::make_shared<live_query>(selector, shared_from_this());
+        db_path = path;
+        db_mode = mode;
     }
 
     int collection::count(nlohmann::json::object_t const& selector) throw(std::runtime_error)
@@ -97,44 +118,26 @@ namespace meteorpp {
         return query(selector, nlohmann::json::object(), JBQRYCOUNT);
     }
 
-    std::vector<nlohmann::json::object_t> collection::find(nlohmann::json::object_t const& selector) throw(std::runtime_error)
+    std::vector<nlohmann::json::object_t> collection::find(nlohmann::json::object_t const& selector, find_options const& options) throw(std::runtime_error)
     {
-        return query(selector);
+        return execute(compile(selector, nlohmann::json::object(), options).get());
     }
 
-    nlohmann::json::object_t collection::find_one(nlohmann::json::object_t const& selector) throw(std::runtime_error)
+    nlohmann::json::object_t collection::find_one(nlohmann::json::object_t const& selector, find_options const& options) throw(std::runtime_error)
     {
-        return query(selector, nlohmann::json::object(), JBQRYFINDONE);
+        return execute(compile(selector, nlohmann::json::object(), options).get(), nlohmann::json::object(), JBQRYFINDONE);
     }
 
-    std::string collection::insert(nlohmann::json::object_t const& document) throw(std::runtime_error)
+    cursor collection::find_cursor(nlohmann::json::object_t const& selector, find_options const& options) throw(ejdb_exception)
     {
-        bson_oid_t oid;
-
-        std::shared_ptr<bson> bson_doc = convert_to_bson(document);
-        if(document.find("_id") != document.end()) {
-            std::string const &id = document.find("_id")->second;
-            if(!ejdbisvalidoidstr(id.c_str())) {
-                throw ejdb_exception(JBEINVALIDBSONPK);
-            }
-            bson_oid_from_string(&oid, id.c_str());
-            std::shared_ptr<bson> bson_oid(bson_create(), bson_del);
-            bson_init(bson_oid.get());
-            bson_append_oid(bson_oid.get(), "_id", &oid);
-            bson_finish(bson_oid.get());
-            std::shared_ptr<bson> bson_doc_with_oid(bson_create(), bson_del);
-            bson_init(bson_doc_with_oid.get());
-            bson_merge(bson_oid.get(), bson_doc.get(), true, bson_doc_with_oid.get());
-            bson_finish(bson_doc_with_oid.get());
-            bson_doc.swap(bson_doc_with_oid);
-        }
-
-        if(!ejdbsavebson(_coll.get(), bson_doc.get(), &oid)) {
-            throw_last_ejdb_exception();
-        }
+        return execute_cursor(compile(selector, nlohmann::json::object(), options).get());
+    }
 
-        std::string id(24, '\0');
-        bson_oid_to_string(&oid, &id[0]);
+    std::string collection::insert(nlohmann::json::object_t const& document) throw(std::runtime_error)
+    {
+        std::shared_ptr<bson> buffer(bson_create(), bson_del);
+        bson_init(buffer.get());
+        auto const id = save_document(buffer.get(), document);
 
         document_added(id, document);
         return id;
@@ -147,7 +150,24 @@ namespace meteorpp {
 
     int collection::upsert(nlohmann::json::object_t const& selector, nlohmann::json::object_t const& modifier) throw(std::runtime_error)
     {
-        return query(selector, {{ "$upsert", modifier }}).size();
+        int count = 0;
+        std::string id;
+        changeset changes;
+        std::shared_ptr<bson> buffer(bson_create(), bson_del);
+        bson_init(buffer.get());
+        run_in_transaction([&]() {
+            count = query(selector, {{ "$set", modifier }}, 0, &changes).size();
+            if(count == 0) {
+                id = save_document(buffer.get(), modifier);
+            }
+        });
+
+        if(count > 0) {
+            notify_changes(changes);
+            return count;
+        }
+        document_added(id, modifier);
+        return 1;
     }
 
     int collection::remove(nlohmann::json::object_t const& selector) throw(std::runtime_error)
@@ -155,170 +175,356 @@ namespace meteorpp {
         return query(selector, {{ "$dropall", true }}).size();
     }
 
-    nlohmann::json collection::query(nlohmann::json::object_t const& selector, nlohmann::json::object_t const& modifier, int flags) throw(ejdb_exception)
+    std::vector<std::string> collection::insert_many(std::vector<nlohmann::json::object_t> const& documents) throw(std::runtime_error)
+    {
+        std::vector<std::string> ids;
+        ids.reserve(documents.size());
+
+        std::shared_ptr<bson> buffer(bson_create(), bson_del);
+        bson_init(buffer.get());
+        run_in_transaction([&]() {
+            for(auto const& document: documents) {
+                bson_reset(buffer.get());
+                ids.push_back(save_document(buffer.get(), document));
+            }
+        });
+
+        notify_batch([&]() {
+            for(std::size_t i = 0; i < ids.size(); ++i) {
+                document_added(ids[i], documents[i]);
+            }
+        });
+        return ids;
+    }
+
+    int collection::update_many(std::vector<std::pair<nlohmann::json::object_t, nlohmann::json::object_t>> const& updates) throw(std::runtime_error)
+    {
+        int count = 0;
+        changeset changes;
+        run_in_transaction([&]() {
+            for(auto const& update: updates) {
+                count += query(update.first, update.second, 0, &changes).size();
+            }
+        });
+
+        notify_batch([&]() { notify_changes(changes); });
+        return count;
+    }
+
+    int collection::remove_many(std::vector<nlohmann::json::object_t> const& selectors) throw(std::runtime_error)
+    {
+        int count = 0;
+        changeset changes;
+        run_in_transaction([&]() {
+            for(auto const& selector: selectors) {
+                count += query(selector, {{ "$dropall", true }}, 0, &changes).size();
+            }
+        });
+
+        notify_batch([&]() { notify_changes(changes); });
+        return count;
+    }
+
+    void collection::ensure_index(std::string const& path, index_type type) throw(ejdb_exception)
     {
+        if(!ejdbsetindex(_coll.get(), path.c_str(), index_flags(type))) {
+            throw_last_ejdb_exception();
+        }
+    }
+
+    void collection::drop_index(std::string const& path, index_type type) throw(ejdb_exception)
+    {
+        if(!ejdbsetindex(_coll.get(), path.c_str(), index_flags(type) | JBIDXDROP)) {
+            throw_last_ejdb_exception();
+        }
+    }
+
+    void collection::drop_index(std::string const& path) throw(ejdb_exception)
+    {
+        if(!ejdbsetindex(_coll.get(), path.c_str(), JBIDXDROPALL)) {
+            throw_last_ejdb_exception();
+        }
+    }
+
+    std::vector<std::pair<std::string, collection::index_type>> collection::indexes() throw(ejdb_exception)
+    {
+        std::shared_ptr<bson> const meta(ejdbmeta(_db.get()), bson_del);
+        if(!meta) {
+            throw_last_ejdb_exception();
+        }
+
+        std::vector<std::pair<std::string, index_type>> indexes;
+        auto json_meta = bson_to_json(bson_data(meta.get()));
+        for(auto& coll: json_meta["collections"]) {
+            if(coll["name"] != _name) {
+                continue;
+            }
+            for(auto& index: coll["indexes"]) {
+                std::string const iname = index["iname"].is_string() ? index["iname"].get<std::string>() : std::string();
+                index_type type = index_type::string;
+                switch(iname.empty() ? 's' : iname[0]) {
+                    case 'i':
+                        type = index_type::istring;
+                        break;
+                    case 'n':
+                        type = index_type::number;
+                        break;
+                    case 'a':
+                        type = index_type::array;
+                        break;
+                }
+                indexes.push_back(std::make_pair(index["field"].get<std::string>(), type));
+            }
+        }
+        return indexes;
+    }
+
+    std::shared_ptr<prepared_query> collection::prepare(nlohmann::json::object_t const& selector, find_options const& options) throw(std::bad_weak_ptr, ejdb_exception)
+    {
+        return std::shared_ptr<prepared_query>(new prepared_query(std::static_pointer_cast<collection>(shared_from_this()), compile(selector, nlohmann::json::object(), options)));
+    }
+
+    void collection::set_query_cache_capacity(std::size_t capacity)
+    {
+        _query_cache_capacity = capacity;
+        while(_query_cache.size() > _query_cache_capacity) {
+            _query_cache_index.erase(_query_cache.back().first);
+            _query_cache.pop_back();
+        }
+    }
+
+    selector::predicate collection::matcher(nlohmann::json::object_t const& selector) throw(std::runtime_error)
+    {
+        try {
+            return meteorpp::selector(selector);
+        } catch(std::invalid_argument const&) {
+        }
+
+        std::shared_ptr<bson> query;
+        try {
+            query = convert_to_bson(selector);
+        } catch(std::invalid_argument const& e) {
+            throw std::runtime_error(e.what());
+        }
+
+        auto const database = _db;
+        auto* ejdb_query = ejdbcreatequery2(database.get(), bson_data(query.get()));
+        if(!ejdb_query) {
+            throw_last_ejdb_exception();
+        }
+
+        std::shared_ptr<EJQ> const compiled(ejdb_query, ejdbquerydel);
+        return [database, compiled](nlohmann::json::object_t const& document) {
+            return ejdbqrymatch(compiled.get(), convert_to_bson(document).get());
+        };
+    }
+
+    bool collection::selects_ranges_in_sort_order() const
+    {
+        return false;
+    }
+
+    nlohmann::json collection::query(nlohmann::json::object_t const& selector, nlohmann::json::object_t const& modifier, int flags, changeset* changes) throw(ejdb_exception)
+    {
+        return execute(compile(selector, modifier).get(), modifier, flags, changes);
+    }
+
+    std::shared_ptr<EJQ> collection::compile(nlohmann::json::object_t const& selector, nlohmann::json::object_t const& modifier, find_options const& options) throw(ejdb_exception)
+    {
+        bool const with_modifier = !modifier.empty();
+        bool const cacheable = !with_modifier && _query_cache_capacity > 0;
+
+        std::string key;
+        if(cacheable) {
+            key = nlohmann::json(selector).dump() + nlohmann::json({ options.sort, options.skip, options.limit, options.fields }).dump();
+            auto const cached = _query_cache_index.find(key);
+            if(cached != _query_cache_index.end()) {
+                _query_cache.splice(_query_cache.begin(), _query_cache, cached->second);
+                return cached->second->second;
+            }
+        }
+
         nlohmann::json q1 = selector;
         nlohmann::json q2 = modifier;
-
-        bool with_modifier = !q2.empty();
         if(with_modifier) {
             std::swap(q1, q2);
         }
 
-        auto* ejdb_query = ejdbcreatequery(_db.get(), convert_to_bson(q1).get(), with_modifier ? convert_to_bson(q2).get() : nullptr, (int)with_modifier, nullptr);
+        auto const hints = query_hints(options);
+        auto* ejdb_query = ejdbcreatequery(_db.get(), convert_to_bson(q1).get(), with_modifier ? convert_to_bson(q2).get() : nullptr, (int)with_modifier, hints.get());
         if(!ejdb_query) {
             throw_last_ejdb_exception();
         }
 
-        uint32_t count;
-        std::shared_ptr<TCXSTR> log(tcxstrnew(), tcxstrdel);
-        auto cursor = ejdbqryexecute(_coll.get(), ejdb_query, &count, flags, log.get());
-        ejdbquerydel(ejdb_query);
-
-        nlohmann::json updates;
-        nlohmann::json upserts;
-        nlohmann::json dropall;
-        nlohmann::json const json_log = evaluate_log(std::string(log->ptr, log->size));
-        if(json_log.find("updating_mode") != json_log.end() && json_log["updating_mode"]) {
-            if(json_log.find("$update") != json_log.end()) {
-                updates = json_log["$update"];
-                if(updates.type() != nlohmann::json::value_t::array) {
-                    updates = nlohmann::json::array_t({ updates });
-                }
-            }
-            if(json_log.find("$upsert") != json_log.end()) {
-                upserts = json_log["$upsert"];
-                if(upserts.type() != nlohmann::json::value_t::array) {
-                    upserts = nlohmann::json::array_t({ upserts });
-                }
-                for(nlohmann::json::object_t doc: upserts) {
-                    std::string const id = doc["_id"];
-                    doc.erase("_id");
-                    document_added(id, doc);
-                }
-            }
-            if(json_log.find("$dropall") != json_log.end()) {
-                for(std::string const& id: json_log["$dropall"]) {
-                    dropall.push_back(id);
-                }
+        std::shared_ptr<EJQ> compiled(ejdb_query, ejdbquerydel);
+        if(cacheable) {
+            _query_cache.emplace_front(key, compiled);
+            _query_cache_index[key] = _query_cache.begin();
+            if(_query_cache.size() > _query_cache_capacity) {
+                _query_cache_index.erase(_query_cache.back().first);
+                _query_cache.pop_back();
             }
         }
+        return compiled;
+    }
+
+    nlohmann::json collection::execute(EJQ* ejdb_query, nlohmann::json::object_t const& modifier, int flags, changeset* changes) throw(ejdb_exception)
+    {
+        uint32_t count;
+        auto cursor = ejdbqryexecute(_coll.get(), ejdb_query, &count, flags, nullptr);
 
-        nlohmann::json return_val;
         if(flags & JBQRYCOUNT) {
-            return_val = count;
-        } else {
-            std::vector<nlohmann::json::object_t> results;
-            results.reserve(count);
-            for(int i = 0; i < count; ++i) {
-                int data_size = 0;
-                auto const& result = convert_to_json(std::shared_ptr<bson>(bson_create_from_buffer(static_cast<char const*>(ejdbqresultbsondata(cursor, i, &data_size)), data_size), bson_destroy));
-                if(i < updates.size()) {
-                    auto const& update = updates[i];
-                    if(result != update) {
-                        auto const diff = modified_fields(result, update);
-                        document_pre_changed(result["_id"], result, update);
-                        document_changed(result["_id"], diff["fields"], diff["cleared"]);
-                    }
-                }
-                if(i < dropall.size()) {
-                    std::string const& id = dropall[i];
-                    if(result["_id"] == id) {
-                        document_pre_removed(id, result);
-                        document_removed(id);
-                    }
+            return count;
+        }
 
-                }
-                results.push_back(result);
+        std::vector<nlohmann::json::object_t> results;
+        results.reserve(count);
+        for(uint32_t i = 0; i < count; ++i) {
+            int data_size = 0;
+            auto result = bson_to_json(static_cast<char const*>(ejdbqresultbsondata(cursor, i, &data_size)));
+            results.push_back(std::move(result.get_ref<nlohmann::json::object_t&>()));
+        }
+        ejdbqresultdispose(cursor);
+
+        if(!modifier.empty()) {
+            if(changes) {
+                changes->merge(evaluate_changes(results, modifier));
+            } else {
+                notify_changes(evaluate_changes(results, modifier));
             }
-            ejdbqresultdispose(cursor);
-            return_val = results;
         }
 
         if(flags & JBQRYFINDONE) {
-            return_val = return_val.empty() ? nlohmann::json::object() : return_val[0];
-        }
-
-        return return_val;
-    }
-
-    nlohmann::json collection::evaluate_log(std::string const& log)
-    {
-        nlohmann::json json_log;
-        std::istringstream log_stream(log);
-        for(std::string line; std::getline(log_stream, line); ) {
-            auto const delimiter = line.find_first_of(':');
-            if(delimiter != std::string::npos) {
-                std::string key = line.substr(0, delimiter);
-                std::string val = line.substr(delimiter + 2);
-                std::replace(key.begin(), key.end(), ' ', '_');
-                std::transform(key.begin(), key.end(), key.begin(), ::tolower);
-                nlohmann::json json_val;
-                try {
-                    json_val = boost::lexical_cast<long>(val);
-                } catch(boost::bad_lexical_cast const& e) {
-                    if(val == "YES") {
-                        json_val = true;
-                    } else if(val == "NO") {
-                        json_val = false;
-                    } else if(val == "'NONE'") {
-                        json_val = nullptr;
-                    } else {
-                        size_t const bson_hex_delimiter = val.find_first_of('/');
-                        if(bson_hex_delimiter != std::string::npos) {
-                            std::string const bson_hex_string = val.substr(0, bson_hex_delimiter);
-                            std::string bson_decoded_data;
-                            boost::algorithm::unhex(bson_hex_string.begin(), bson_hex_string.end(), back_inserter(bson_decoded_data));
-                            json_val = convert_to_json(std::shared_ptr<bson>(bson_create_from_buffer(bson_decoded_data.data(), bson_decoded_data.size()), bson_del));
-                        } else {
-                            json_val = val;
-                        }
-                    }
-                }
+            return results.empty() ? nlohmann::json::object() : nlohmann::json(results.front());
+        }
+        return results;
+    }
 
-                if(json_log.find(key) != json_log.end()) {
-                    if(json_log[key].type() != nlohmann::json::value_t::array) {
-                        json_log[key] = nlohmann::json::array_t({ json_log[key] });
-                    }
-                    json_log[key].push_back(json_val);
-                } else {
-                    json_log[key] = json_val;
+    cursor collection::execute_cursor(EJQ* ejdb_query) throw(ejdb_exception)
+    {
+        uint32_t count;
+        auto result = ejdbqryexecute(_coll.get(), ejdb_query, &count, 0, nullptr);
+        if(!result) {
+            throw_last_ejdb_exception();
+        }
+        return cursor(result, count);
+    }
 
-                }
+    collection::changeset collection::evaluate_changes(std::vector<nlohmann::json::object_t> const& results, nlohmann::json::object_t const& modifier)
+    {
+        changeset changes;
+        bool const dropall = modifier.find("$dropall") != modifier.end();
+        for(auto const& before: results) {
+            std::string const& id = before.at("_id").get_ref<std::string const&>();
+            if(dropall) {
+                changes.removed.emplace(id, before);
+                continue;
+            }
+
+            bson_oid_t oid;
+            bson_oid_from_string(&oid, id.c_str());
+            std::shared_ptr<bson> const stored(ejdbloadbson(_coll.get(), &oid), bson_del);
+            if(!stored) {
+                changes.removed.emplace(id, before);
+                continue;
+            }
+
+            auto after = bson_to_json(bson_data(stored.get()));
+            if(after != before) {
+                changes.changed.emplace(id, std::make_pair(before, std::move(after.get_ref<nlohmann::json::object_t&>())));
             }
         }
-        return json_log;
+        return changes;
     }
 
-    void collection::throw_last_ejdb_exception() throw(ejdb_exception)
+    void collection::run_in_transaction(std::function<void()> const& work) throw(ejdb_exception)
     {
-        throw ejdb_exception(ejdbecode(_db.get()));
+        if(!ejdbtranbegin(_coll.get())) {
+            throw_last_ejdb_exception();
+        }
+        try {
+            work();
+        } catch(...) {
+            ejdbtranabort(_coll.get());
+            throw;
+        }
+        if(!ejdbtrancommit(_coll.get())) {
+            throw_last_ejdb_exception();
+        }
     }
 
-    nlohmann::json collection::modified_fields(nlohmann::json::object_t const& a, nlohmann::json::object_t const& b)
+    std::string collection::save_document(bson* buffer, nlohmann::json::object_t const& document) throw(ejdb_exception)
     {
-        nlohmann::json::object_t diff;
-        std::set_difference(b.begin(), b.end(), a.begin(), a.end(), std::inserter(diff, diff.begin()));
+        bson_oid_t oid;
 
-        std::vector<std::string> cleared_fields;
-        for(auto const& field: a) {
-            if(b.find(field.first) == b.end()) {
-                cleared_fields.push_back(field.first);
+        auto const id_field = document.find("_id");
+        if(id_field != document.end()) {
+            if(!id_field->second.is_string() || !ejdbisvalidoidstr(id_field->second.get_ref<std::string const&>().c_str())) {
+                throw ejdb_exception(JBEINVALIDBSONPK);
+            }
+            bson_oid_from_string(&oid, id_field->second.get_ref<std::string const&>().c_str());
+            bson_append_oid(buffer, "_id", &oid);
+        }
+        for(auto const& field: document) {
+            if(field.first != "_id") {
+                append_to_bson(buffer, field.first.c_str(), field.second);
             }
         }
-        return {{ "fields", diff }, { "cleared", cleared_fields }};
+        if(bson_finish(buffer) != BSON_OK) {
+            throw ejdb_exception(JBEINVALIDBSON);
+        }
+
+        if(!ejdbsavebson(_coll.get(), buffer, &oid)) {
+            throw_last_ejdb_exception();
+        }
+
+        std::string id(24, '\0');
+        bson_oid_to_string(&oid, &id[0]);
+        return id;
+    }
+
+    void collection::throw_last_ejdb_exception() throw(ejdb_exception)
+    {
+        throw ejdb_exception(ejdbecode(_db.get()));
     }
 
     nlohmann::json collection::convert_to_json(std::shared_ptr<bson> const& value)
     {
-        char* buffer;
-        int size = 0;
-        bson2json(bson_data(value.get()), &buffer, &size);
-        return nlohmann::json::parse(std::string(buffer, size));
+        return bson_to_json(bson_data(value.get()));
     }
 
     std::shared_ptr<bson> collection::convert_to_bson(nlohmann::json const& value)
     {
-        return std::shared_ptr<bson>(json2bson(value.dump().c_str()), bson_del);
+        return json_to_bson(value);
+    }
+
+    std::shared_ptr<bson> collection::query_hints(find_options const& options)
+    {
+        nlohmann::json::object_t hints;
+        if(options.skip > 0) {
+            hints["$skip"] = options.skip;
+        }
+        if(options.limit > 0) {
+            hints["$max"] = options.limit;
+        }
+        if(!options.fields.empty()) {
+            hints["$fields"] = options.fields;
+        }
+        if(hints.empty() && options.sort.empty()) {
+            return nullptr;
+        }
+
+        std::shared_ptr<bson> out(bson_create(), bson_del);
+        bson_init(out.get());
+        if(!options.sort.empty()) {
+            bson_append_start_object(out.get(), "$orderby");
+            for(auto const& key: options.sort) {
+                bson_append_int(out.get(), key.first.c_str(), key.second);
+            }
+            bson_append_finish_object(out.get());
+        }
+        append_to_bson(out.get(), hints);
+        bson_finish(out.get());
+        return out;
     }
 }
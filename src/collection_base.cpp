@@ -0,0 +1,166 @@
+/*
+ * Copyright (c) 2015, Mario Flach. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include "../include/meteorpp/collection.hpp"
+#include "../include/meteorpp/live_aggregate.hpp"
+#include "../include/meteorpp/live_query.hpp"
+#include "../include/meteorpp/live_query_multiplexer.hpp"
+
+namespace meteorpp {
+    namespace {
+        void diff_fields(std::string const& prefix, nlohmann::json::object_t const& a, nlohmann::json::object_t const& b, nlohmann::json::object_t& fields, std::vector<std::string>& cleared)
+        {
+            for(auto const& field: b) {
+                auto const previous = a.find(field.first);
+                if(previous == a.end()) {
+                    fields[prefix + field.first] = field.second;
+                } else if(previous->second == field.second) {
+                    continue;
+                } else if(previous->second.is_object() && field.second.is_object()) {
+                    diff_fields(prefix + field.first + '.', previous->second.get_ref<nlohmann::json::object_t const&>(), field.second.get_ref<nlohmann::json::object_t const&>(), fields, cleared);
+                } else {
+                    fields[prefix + field.first] = field.second;
+                }
+            }
+            for(auto const& field: a) {
+                if(b.find(field.first) == b.end()) {
+                    cleared.push_back(prefix + field.first);
+                }
+            }
+        }
+    }
+
+    collection_base::collection_base()
+    {
+        document_added.connect(std::bind(&live_query_router::document_added, &_router, std::placeholders::_1, std::placeholders::_2));
+        document_pre_changed.connect(std::bind(&live_query_router::document_changed, &_router, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+        document_pre_removed.connect(std::bind(&live_query_router::document_removed, &_router, std::placeholders::_1, std::placeholders::_2));
+    }
+
+    collection_base::~collection_base()
+    {
+    }
+
+    std::shared_ptr<live_query> collection_base::track(nlohmann::json::object_t const& selector, find_options const& options) throw(std::bad_weak_ptr, std::runtime_error)
+    {
+        return std::make_shared<live_query>(selector, options, shared_from_this());
+    }
+
+    std::shared_ptr<live_aggregate> collection_base::aggregate(nlohmann::json::object_t const& selector, std::string const& field, std::string const& group_by) throw(std::bad_weak_ptr, std::runtime_error)
+    {
+        return std::make_shared<live_aggregate>(selector, field, group_by, shared_from_this());
+    }
+
+    std::shared_ptr<live_query_multiplexer> collection_base::multiplex(nlohmann::json::object_t const& selector, find_options const& options) throw(std::bad_weak_ptr, std::runtime_error)
+    {
+        auto const key = live_query_multiplexer::key(selector, options);
+        auto const registered = _multiplexers.find(key);
+        if(registered != _multiplexers.end()) {
+            if(auto const multiplexer = registered->second.lock()) {
+                return multiplexer;
+            }
+        }
+
+        auto const multiplexer = std::make_shared<live_query_multiplexer>(key, selector, options, shared_from_this());
+        _multiplexers[key] = multiplexer;
+        return multiplexer;
+    }
+
+    selector::predicate collection_base::matcher(nlohmann::json::object_t const& selector) throw(std::runtime_error)
+    {
+        try {
+            return meteorpp::selector(selector);
+        } catch(std::invalid_argument const& e) {
+            throw std::runtime_error(e.what());
+        }
+    }
+
+    bool collection_base::selects_ranges_in_sort_order() const
+    {
+        return true;
+    }
+
+    void collection_base::notify_changes(changeset const& changes)
+    {
+        for(auto const& change: changes.changed) {
+            auto const& before = change.second.first;
+            auto const& after = change.second.second;
+            auto const diff = modified_fields(before, after);
+            document_pre_changed(change.first, before, after);
+            document_changed(change.first, diff["fields"], diff["cleared"]);
+        }
+        for(auto const& removal: changes.removed) {
+            document_pre_removed(removal.first, removal.second);
+            document_removed(removal.first);
+        }
+    }
+
+    void collection_base::notify_batch(std::function<void()> const& notify)
+    {
+        if(_batch_depth++ == 0) {
+            _router.begin_batch();
+        }
+        try {
+            notify();
+        } catch(...) {
+            if(--_batch_depth == 0) {
+                _router.commit_batch();
+                batch_committed();
+            }
+            throw;
+        }
+        if(--_batch_depth == 0) {
+            _router.commit_batch();
+            batch_committed();
+        }
+    }
+
+    void collection_base::changeset::merge(changeset&& other)
+    {
+        for(auto& change: other.changed) {
+            auto const it = changed.find(change.first);
+            if(it != changed.end()) {
+                it->second.second = std::move(change.second.second);
+            } else {
+                changed.insert(std::move(change));
+            }
+        }
+        for(auto& removal: other.removed) {
+            auto const it = changed.find(removal.first);
+            if(it != changed.end()) {
+                removed[removal.first] = std::move(it->second.first);
+                changed.erase(it);
+            } else {
+                removed.insert(std::move(removal));
+            }
+        }
+    }
+
+    nlohmann::json collection_base::modified_fields(nlohmann::json::object_t const& a, nlohmann::json::object_t const& b)
+    {
+        nlohmann::json::object_t diff;
+        std::vector<std::string> cleared_fields;
+        diff_fields(std::string(), a, b, diff, cleared_fields);
+        return {{ "fields", diff }, { "cleared", cleared_fields }};
+    }
+}
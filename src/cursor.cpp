@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2015, Mario Flach. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include <ejdb/ejdb.h>
+
+#include "../include/meteorpp/bson.hpp"
+#include "../include/meteorpp/cursor.hpp"
+
+namespace meteorpp {
+    cursor::iterator::iterator()
+        : _cursor(nullptr), _position(0)
+    {
+    }
+
+    cursor::iterator::iterator(cursor* cursor, std::size_t position)
+        : _cursor(cursor), _position(position)
+    {
+    }
+
+    nlohmann::json::object_t const& cursor::iterator::operator*() const
+    {
+        return _cursor->document(_position);
+    }
+
+    nlohmann::json::object_t const* cursor::iterator::operator->() const
+    {
+        return &_cursor->document(_position);
+    }
+
+    cursor::iterator& cursor::iterator::operator++()
+    {
+        ++_position;
+        return *this;
+    }
+
+    cursor::iterator cursor::iterator::operator++(int)
+    {
+        auto const it = *this;
+        ++_position;
+        return it;
+    }
+
+    bool cursor::iterator::operator==(iterator const& other) const
+    {
+        return _position == other._position;
+    }
+
+    bool cursor::iterator::operator!=(iterator const& other) const
+    {
+        return !(*this == other);
+    }
+
+    cursor::cursor(void* result, std::size_t count)
+        : _result(result, [](void* result) { ejdbqresultdispose(static_cast<EJQRESULT>(result)); }), _count(count), _position(count)
+    {
+    }
+
+    cursor::~cursor()
+    {
+    }
+
+    std::size_t cursor::count() const
+    {
+        return _count;
+    }
+
+    cursor::iterator cursor::begin()
+    {
+        return iterator(this, 0);
+    }
+
+    cursor::iterator cursor::end()
+    {
+        return iterator(this, _count);
+    }
+
+    nlohmann::json::object_t const& cursor::document(std::size_t position)
+    {
+        if(position != _position) {
+            int data_size = 0;
+            auto document = bson_to_json(static_cast<char const*>(ejdbqresultbsondata(static_cast<EJQRESULT>(_result.get()), position, &data_size)));
+            _document = std::move(document.get_ref<nlohmann::json::object_t&>());
+            _position = position;
+        }
+        return _document;
+    }
+}
@@ -23,16 +23,55 @@
 
 #include <boost/random/random_device.hpp>
 #include <boost/random/uniform_int_distribution.hpp>
+#include <boost/random/uniform_real_distribution.hpp>
 
 #include "../include/meteorpp/ddp.hpp"
 
 namespace meteorpp {
+    namespace {
+        nlohmann::json const& member(nlohmann::json const& payload, char const* key)
+        {
+            static nlohmann::json const null_value;
+            auto const it = payload.find(key);
+            return it != payload.end() ? *it : null_value;
+        }
+
+        /* Returns a string member by reference, or an empty string if it is missing.
+         */
+        std::string const& string_member(nlohmann::json const& payload, char const* key)
+        {
+            static std::string const empty;
+            auto const& value = member(payload, key);
+            return value.is_string() ? value.get_ref<std::string const&>() : empty;
+        }
+
+        /* Returns an object member by reference, or an empty object if it is missing.
+         */
+        nlohmann::json::object_t const& object_member(nlohmann::json const& payload, char const* key)
+        {
+            static nlohmann::json::object_t const empty;
+            auto const& value = member(payload, key);
+            return value.is_object() ? value.get_ref<nlohmann::json::object_t const&>() : empty;
+        }
+    }
+
     ddp::ddp(boost::asio::io_service& io_service, std::string const& session)
-        : _session(session)
+        : _io_service(io_service), _session(session), _reconnect_timer(io_service), _flush_timer(io_service)
     {
+        std::weak_ptr<void> const lifetime = _lifetime;
         _client.init_asio(&io_service);
         _client.set_open_handler(std::bind(&ddp::init_session, this));
         _client.set_message_handler(std::bind(&ddp::on_message, this, std::placeholders::_2));
+        _client.set_close_handler([this, lifetime](websocketpp::connection_hdl) {
+            if(!lifetime.expired()) {
+                on_closed();
+            }
+        });
+        _client.set_fail_handler([this, lifetime](websocketpp::connection_hdl) {
+            if(!lifetime.expired()) {
+                on_closed();
+            }
+        });
         _client.clear_access_channels(websocketpp::log::alevel::all);
         _client.clear_error_channels(websocketpp::log::alevel::all);
     }
@@ -53,64 +92,97 @@ namespace meteorpp {
         if(error_code) {
             throw websocketpp::exception("Connection error", error_code);
         }
+        _url = url;
 
-        _connected_sig.connect_extended([=](boost::signals2::connection const& conn, std::string const& session) {
-            slot(session);
-            conn.disconnect();
-        });
+        if(slot.slot_function()) {
+            _connected_sig.connect_extended([=](boost::signals2::connection const& conn, std::string const& session) {
+                slot(session);
+                conn.disconnect();
+            });
+        }
         _client.connect(_conn);
     }
 
-    std::string ddp::call_method(std::string const& name, nlohmann::json::array_t const& params, method_result_signal::slot_type const& slot) throw(websocketpp::exception)
+    void ddp::set_send_batching(boost::posix_time::time_duration const& max_delay, std::size_t max_batch_size)
+    {
+        _flush_delay = max_delay;
+        _max_batch_size = max_batch_size;
+    }
+
+    void ddp::set_max_queued_messages(std::size_t max_queued)
+    {
+        _max_queued = max_queued;
+    }
+
+    void ddp::set_reconnect_delay(boost::posix_time::time_duration const& initial, boost::posix_time::time_duration const& maximum)
+    {
+        _reconnect_initial = initial;
+        _reconnect_maximum = maximum;
+    }
+
+    std::string ddp::call_method(std::string const& name, nlohmann::json::array_t const& params, method_result_signal::slot_type const& slot, boost::posix_time::time_duration const& timeout) throw(websocketpp::exception)
     {
         auto i = random_method_id();
-        if(slot.slot_function()) {
-            _method_result_sig.connect_extended([=](boost::signals2::connection const& conn, std::string const& id, nlohmann::json const& result, nlohmann::json const& error) {
-                if(id == i) {
-                    slot(id, result, error);
-                    conn.disconnect();
-                }
-            });
-        }
 
         nlohmann::json payload;
         payload["msg"] = "method";
         payload["method"] = name;
         payload["id"] = i;
         payload["params"] = params;
-        _conn->send(payload.dump(), websocketpp::frame::opcode::text);
+        send(payload, _queued_methods, i);
 
+        auto& pending = _pending_methods.emplace(i, pending_method{ slot, nullptr }).first->second;
+        if(timeout > boost::posix_time::time_duration()) {
+            std::weak_ptr<void> const lifetime = _lifetime;
+            pending.timer.reset(new boost::asio::deadline_timer(_io_service, timeout));
+            pending.timer->async_wait([=](boost::system::error_code const& error_code) {
+                if(!error_code && !lifetime.expired()) {
+                    on_method_result(i, nullptr, {{ "error", "timeout" }, { "reason", "Method call timed out" }, { "errorType", "Meteor.Error" }});
+                }
+            });
+        }
         return i;
     }
 
-    std::string ddp::subscribe(std::string const& name, nlohmann::json::array_t const& params, ready_signal::slot_type const& slot) throw(websocketpp::exception)
+    std::size_t ddp::pending_methods() const
+    {
+        return _pending_methods.size();
+    }
+
+    std::string ddp::subscribe(std::string const& name, nlohmann::json::array_t const& params, ready_signal::slot_type const& slot, nosub_signal::slot_type const& error_slot) throw(websocketpp::exception)
     {
         auto const i = random_id();
-        if(slot.slot_function()) {
-            _ready_sig.connect_extended([=](boost::signals2::connection const& conn, std::string const& id) {
-                if(id == i) {
-                    slot(i);
-                    conn.disconnect();
-                }
-            });
-        }
 
         nlohmann::json payload;
         payload["msg"] = "sub";
         payload["name"] = name;
         payload["id"] = i;
         payload["params"] = params;
-        _conn->send(payload.dump(), websocketpp::frame::opcode::text);
+        send(payload, _queued_subscriptions, i);
 
+        _subscriptions.emplace(i, subscription{ name, params, subscription_state::pending, slot, error_slot });
         return i;
     }
 
     void ddp::unsubscribe(std::string const& id) throw(websocketpp::exception)
     {
-        nlohmann::json payload;
-        payload["msg"] = "unsub";
-        payload["id"] = id;
-        _conn->send(payload.dump(), websocketpp::frame::opcode::text);
+        auto const it = _subscriptions.find(id);
+        bool const failed = it != _subscriptions.end() && it->second.state == subscription_state::failed;
+        bool const queued = _queued_subscriptions.count(id) > 0;
+        if(!failed && (queued || (_conn && _conn->get_state() == websocketpp::session::state::open))) {
+            nlohmann::json payload;
+            payload["msg"] = "unsub";
+            payload["id"] = id;
+            send(payload);
+        }
+        _queued_subscriptions.erase(id);
+        _subscriptions.erase(id);
+    }
+
+    ddp::subscription_state ddp::subscription_status(std::string const& id) const
+    {
+        auto const it = _subscriptions.find(id);
+        return it != _subscriptions.end() ? it->second.state : subscription_state::stopped;
     }
 
     boost::signals2::connection ddp::on_connected(connected_signal::slot_type const& slot)
@@ -118,11 +190,21 @@ namespace meteorpp {
         return _connected_sig.connect(slot);
     }
 
+    boost::signals2::connection ddp::on_reconnected(connected_signal::slot_type const& slot)
+    {
+        return _reconnected_sig.connect(slot);
+    }
+
     boost::signals2::connection ddp::on_ready(ready_signal::slot_type const& slot)
     {
         return _ready_sig.connect(slot);
     }
 
+    boost::signals2::connection ddp::on_nosub(nosub_signal::slot_type const& slot)
+    {
+        return _nosub_sig.connect(slot);
+    }
+
     boost::signals2::connection ddp::on_synchronized(method_updated_signal::slot_type const& slot)
     {
         return _method_updated_sig.connect(slot);
@@ -155,6 +237,134 @@ namespace meteorpp {
         _conn->send(payload.dump(), websocketpp::frame::opcode::text);
     }
 
+    void ddp::send(nlohmann::json const& payload) throw(websocketpp::exception)
+    {
+        if(!_established && _max_queued > 0 && _outbound.size() >= _max_queued) {
+            throw websocketpp::exception("couldn't queue message, too many messages are waiting for the connection");
+        }
+        _outbound.push_back(payload.dump());
+        if(_max_batch_size > 0 && _outbound.size() >= _max_batch_size) {
+            flush_outbound();
+        } else if(!_flush_scheduled) {
+            _flush_scheduled = true;
+            std::weak_ptr<void> const lifetime = _lifetime;
+            auto const flush = [=](boost::system::error_code const& error_code) {
+                if(!error_code && !lifetime.expired()) {
+                    flush_outbound();
+                }
+            };
+            if(_flush_delay > boost::posix_time::time_duration()) {
+                _flush_timer.expires_from_now(_flush_delay);
+                _flush_timer.async_wait(flush);
+            } else {
+                _io_service.post(std::bind(flush, boost::system::error_code()));
+            }
+        }
+    }
+
+    void ddp::send(nlohmann::json const& payload, std::unordered_set<std::string>& queued, std::string const& id) throw(websocketpp::exception)
+    {
+        queued.insert(id);
+        try {
+            send(payload);
+        } catch(...) {
+            queued.erase(id);
+            throw;
+        }
+    }
+
+    void ddp::flush_outbound()
+    {
+        if(!_established || !_conn || _conn->get_state() != websocketpp::session::state::open) {
+            return;
+        }
+        _flush_scheduled = false;
+        _flush_timer.cancel();
+
+        std::vector<std::string> outbound;
+        outbound.swap(_outbound);
+        _queued_subscriptions.clear();
+        _queued_methods.clear();
+        for(auto const& message: outbound) {
+            _conn->send(message, websocketpp::frame::opcode::text);
+        }
+    }
+
+    void ddp::open_connection()
+    {
+        websocketpp::lib::error_code error_code;
+        auto const conn = _client.get_connection(_url, error_code);
+        if(error_code) {
+            on_closed();
+            return;
+        }
+        _conn = conn;
+        _client.connect(_conn);
+    }
+
+    void ddp::on_closed()
+    {
+        bool const was_established = _established;
+        _established = false;
+        fail_pending_methods();
+        if(_url.empty() || _reconnect_initial <= boost::posix_time::time_duration()) {
+            return;
+        }
+
+        auto delay = _reconnect_initial;
+        for(unsigned int i = 0; i < _reconnect_attempts && delay < _reconnect_maximum; ++i) {
+            delay *= 2;
+        }
+        if(delay > _reconnect_maximum) {
+            delay = _reconnect_maximum;
+        }
+        boost::random::random_device random;
+        boost::random::uniform_real_distribution<> jitter(0.5, 1.0);
+        delay = boost::posix_time::milliseconds(static_cast<long>(delay.total_milliseconds() * jitter(random)));
+
+        ++_reconnect_attempts;
+        if(was_established) {
+            _reconnecting = true;
+        }
+        std::weak_ptr<void> const lifetime = _lifetime;
+        _reconnect_timer.expires_from_now(delay);
+        _reconnect_timer.async_wait([=](boost::system::error_code const& error_code) {
+            if(!error_code && !lifetime.expired()) {
+                open_connection();
+            }
+        });
+    }
+
+    void ddp::fail_pending_methods()
+    {
+        std::vector<std::string> sent;
+        for(auto const& pending: _pending_methods) {
+            if(_queued_methods.count(pending.first) == 0) {
+                sent.push_back(pending.first);
+            }
+        }
+        for(auto const& id: sent) {
+            on_method_result(id, nullptr, {{ "error", "disconnected" }, { "reason", "Connection closed before the method returned" }, { "errorType", "Meteor.Error" }});
+        }
+    }
+
+    void ddp::replay_subscriptions()
+    {
+        for(auto& subscription: _subscriptions) {
+            if(subscription.second.state == subscription_state::failed || _queued_subscriptions.count(subscription.first) > 0) {
+                continue;
+            }
+            subscription.second.state = subscription_state::pending;
+
+            nlohmann::json payload;
+            payload["msg"] = "sub";
+            payload["name"] = subscription.second.name;
+            payload["id"] = subscription.first;
+            payload["params"] = subscription.second.params;
+            send(payload, _queued_subscriptions, subscription.first);
+        }
+    }
+
     std::string ddp::random_id(unsigned int length) const
     {
         std::string id;
@@ -180,42 +390,140 @@ namespace meteorpp {
     void ddp::on_message(client::message_ptr const& msg)
     {
         auto const payload = nlohmann::json::parse(msg->get_payload());
-        auto const message = payload["msg"];
-        if(message.is_null()) {
-            // ignore
-        } else if(message == "connected") {
-            _session = payload["session"].get<std::string>();
-            _connected_sig(_session);
-        } else if(message == "failed") {
-            // throw error
-        } else if(message == "ping") {
-            nlohmann::json response;
-            response["msg"] = "pong";
-            response["id"] = payload["id"];
-            _conn->send(response.dump(), websocketpp::frame::opcode::text);
-        } else if(message == "error") {
-            // throw error
-        } else if(message == "nosub") {
-            // throw error
-        } else if(message == "added") {
-            nlohmann::json const& fields = payload["fields"];
-            _doc_added_sig(payload["collection"], payload["id"], !fields.is_null() ? fields : nlohmann::json::object());
-        } else if(message == "changed") {
-            nlohmann::json const& fields = payload["fields"];
-            nlohmann::json const& cleared = payload["cleared"];
-            _doc_changed_sig(payload["collection"], payload["id"], !fields.is_null() ? fields : nlohmann::json::object(), !cleared.is_null() ? cleared : nlohmann::json::array());
-        } else if(message == "removed") {
-            _doc_removed_sig(payload["collection"], payload["id"]);
-        } else if(message == "ready") {
-            for(std::string const& id: payload["subs"]) {
-                _ready_sig(id);
+        switch(decode_message_type(payload)) {
+            case message_type::connected:
+                _session = string_member(payload, "session");
+                _established = true;
+                _reconnect_attempts = 0;
+                _connected_sig(_session);
+                if(_reconnecting) {
+                    _reconnecting = false;
+                    _reconnected_sig(_session);
+                    replay_subscriptions();
+                }
+                flush_outbound();
+                break;
+            case message_type::ping: {
+                nlohmann::json response;
+                response["msg"] = "pong";
+                auto const& id = member(payload, "id");
+                if(!id.is_null()) {
+                    response["id"] = id;
+                }
+                _conn->send(response.dump(), websocketpp::frame::opcode::text);
+                break;
+            }
+            case message_type::nosub:
+                on_subscription_stopped(string_member(payload, "id"), member(payload, "error"));
+                break;
+            case message_type::added:
+                _doc_added_sig(string_member(payload, "collection"), string_member(payload, "id"), object_member(payload, "fields"));
+                break;
+            case message_type::changed: {
+                std::vector<std::string> cleared;
+                auto const& cleared_fields = member(payload, "cleared");
+                if(cleared_fields.is_array()) {
+                    cleared.reserve(cleared_fields.size());
+                    for(auto const& field: cleared_fields) {
+                        cleared.push_back(field.get<std::string>());
+                    }
+                }
+                _doc_changed_sig(string_member(payload, "collection"), string_member(payload, "id"), object_member(payload, "fields"), cleared);
+                break;
             }
-        } else if(message == "updated") {
-            for(std::string const& id: payload["methods"]) {
-                _method_updated_sig(id);
+            case message_type::removed:
+                _doc_removed_sig(string_member(payload, "collection"), string_member(payload, "id"));
+                break;
+            case message_type::ready:
+                for(auto const& id: member(payload, "subs")) {
+                    on_subscription_ready(id.get_ref<std::string const&>());
+                }
+                break;
+            case message_type::updated:
+                for(auto const& id: member(payload, "methods")) {
+                    _method_updated_sig(id.get_ref<std::string const&>());
+                }
+                break;
+            case message_type::result:
+                on_method_result(string_member(payload, "id"), member(payload, "result"), member(payload, "error"));
+                break;
+            case message_type::failed:
+            case message_type::error:
+                // throw error
+                break;
+            case message_type::unknown:
+                break;
+        }
+    }
+
+    ddp::message_type ddp::decode_message_type(nlohmann::json const& payload)
+    {
+        static std::unordered_map<std::string, message_type> const types = {
+            { "connected", message_type::connected },
+            { "failed", message_type::failed },
+            { "ping", message_type::ping },
+            { "error", message_type::error },
+            { "nosub", message_type::nosub },
+            { "added", message_type::added },
+            { "changed", message_type::changed },
+            { "removed", message_type::removed },
+            { "ready", message_type::ready },
+            { "updated", message_type::updated },
+            { "result", message_type::result }
+        };
+        auto const& message = member(payload, "msg");
+        if(!message.is_string()) {
+            return message_type::unknown;
+        }
+        auto const type = types.find(message.get_ref<std::string const&>());
+        return type != types.end() ? type->second : message_type::unknown;
+    }
+
+    void ddp::on_method_result(std::string const& id, nlohmann::json const& result, nlohmann::json const& error)
+    {
+        auto const it = _pending_methods.find(id);
+        if(it == _pending_methods.end()) {
+            return;
+        }
+        auto const pending = std::move(it->second);
+        _pending_methods.erase(it);
+        if(pending.timer) {
+            pending.timer->cancel();
+        }
+        if(pending.slot.slot_function()) {
+            pending.slot(id, result, error);
+        }
+    }
+
+    void ddp::on_subscription_ready(std::string const& id)
+    {
+        auto const it = _subscriptions.find(id);
+        if(it != _subscriptions.end() && it->second.state == subscription_state::pending) {
+            it->second.state = subscription_state::ready;
+            auto const slot = it->second.ready_slot;
+            if(slot.slot_function()) {
+                slot(id);
+            }
+        }
+        _ready_sig(id);
+    }
+
+    void ddp::on_subscription_stopped(std::string const& id, nlohmann::json const& error)
+    {
+        auto const it = _subscriptions.find(id);
+        if(it != _subscriptions.end()) {
+            auto const slot = it->second.error_slot;
+            if(error.is_null()) {
+                _subscriptions.erase(it);
+            } else {
+                it->second.state = subscription_state::failed;
+                it->second.ready_slot = ready_signal::slot_function_type();
+                it->second.error_slot = nosub_signal::slot_function_type();
+                if(slot.slot_function()) {
+                    slot(id, error);
+                }
             }
-        } else if(message == "result") {
-            _method_result_sig(payload["id"], payload["result"], payload["error"]);
         }
+        _nosub_sig(id, error);
     }
 }
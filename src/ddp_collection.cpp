@@ -26,57 +26,99 @@
 #include "../include/meteorpp/ddp_collection.hpp"
 
 namespace meteorpp {
-    ddp_collection::~ddp_collection()
+    template<typename collection_t>
+    basic_ddp_collection<collection_t>::~basic_ddp_collection()
     {
         _ddp->unsubscribe(_subscription);
     }
 
-    std::string ddp_collection::insert(nlohmann::json::object_t const& document) throw(std::runtime_error)
+    template<typename collection_t>
+    std::string basic_ddp_collection<collection_t>::insert(nlohmann::json::object_t const& document) throw(std::runtime_error)
     {
         boost::signals2::scoped_connection conn;
         if(!_doc_insert_push.connected()) {
             throw std::runtime_error("couldn't execute insert command, database not ready");
         } else if(_doc_insert_push.blocked()) {
-            conn = document_added.connect(std::bind(&ddp_collection::commit_insert, this, std::placeholders::_1, std::placeholders::_2));
+            conn = this->document_added.connect(std::bind(&basic_ddp_collection::commit_insert, this, std::placeholders::_1, std::placeholders::_2));
         }
-        return collection::insert(document);
+        return collection_t::insert(document);
     }
 
-    int ddp_collection::update(nlohmann::json::object_t const& selector, nlohmann::json::object_t const& modifier) throw(std::runtime_error)
+    template<typename collection_t>
+    int basic_ddp_collection<collection_t>::update(nlohmann::json::object_t const& selector, nlohmann::json::object_t const& modifier) throw(std::runtime_error)
     {
         boost::signals2::scoped_connection conn;
         if(!_doc_update_push.connected()) {
             throw std::runtime_error("couldn't execute update command, database not ready");
         } else if(_doc_update_push.blocked()) {
-            conn = document_changed.connect(std::bind(&ddp_collection::commit_update, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+            conn = this->document_changed.connect(std::bind(&basic_ddp_collection::commit_update, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
         }
-        return collection::update(selector, modifier);
+        return collection_t::update(selector, modifier);
     }
 
-    int ddp_collection::upsert(nlohmann::json::object_t const& selector, nlohmann::json::object_t const& modifier) throw(std::runtime_error)
+    template<typename collection_t>
+    int basic_ddp_collection<collection_t>::upsert(nlohmann::json::object_t const& selector, nlohmann::json::object_t const& modifier) throw(std::runtime_error)
     {
         boost::signals2::scoped_connection conn1, conn2;
         if(!_doc_insert_push.connected() || !_doc_update_push.connected()) {
             throw std::runtime_error("couldn't execute upsert command, database not ready");
         } else if(_doc_insert_push.blocked() || _doc_update_push.blocked()) {
-            conn1 = document_added.connect(std::bind(&ddp_collection::commit_insert, this, std::placeholders::_1, std::placeholders::_2));
-            conn1 = document_added.connect(std::bind(&ddp_collection::commit_insert, this, std::placeholders::_1, std::placeholders::_2));
+            conn1 = this->document_added.connect(std::bind(&basic_ddp_collection::commit_insert, this, std::placeholders::_1, std::placeholders::_2));
+            conn1 = this->document_added.connect(std::bind(&basic_ddp_collection::commit_insert, this, std::placeholders::_1, std::placeholders::_2));
         }
-        return collection::upsert(selector, modifier);
+        return collection_t::upsert(selector, modifier);
     }
 
-    int ddp_collection::remove(nlohmann::json::object_t const& selector) throw(std::runtime_error)
+    template<typename collection_t>
+    int basic_ddp_collection<collection_t>::remove(nlohmann::json::object_t const& selector) throw(std::runtime_error)
     {
         boost::signals2::scoped_connection conn;
         if(!_doc_remove_push.connected()) {
             throw std::runtime_error("couldn't execute remove command, database not ready");
         } else if(_doc_insert_push.blocked() || _doc_update_push.blocked() || _doc_remove_push.blocked()) {
-            conn = document_removed.connect(std::bind(&ddp_collection::commit_remove, this, std::placeholders::_1));
+            conn = this->document_removed.connect(std::bind(&basic_ddp_collection::commit_remove, this, std::placeholders::_1));
         }
-        return collection::remove(selector);
+        return collection_t::remove(selector);
     }
 
-    void ddp_collection::on_ready(ready_signal::slot_type const& slot)
+    template<typename collection_t>
+    std::vector<std::string> basic_ddp_collection<collection_t>::insert_many(std::vector<nlohmann::json::object_t> const& documents) throw(std::runtime_error)
+    {
+        boost::signals2::scoped_connection conn;
+        if(!_doc_insert_push.connected()) {
+            throw std::runtime_error("couldn't execute insert command, database not ready");
+        } else if(_doc_insert_push.blocked()) {
+            conn = this->document_added.connect(std::bind(&basic_ddp_collection::commit_insert, this, std::placeholders::_1, std::placeholders::_2));
+        }
+        return collection_t::insert_many(documents);
+    }
+
+    template<typename collection_t>
+    int basic_ddp_collection<collection_t>::update_many(std::vector<std::pair<nlohmann::json::object_t, nlohmann::json::object_t>> const& updates) throw(std::runtime_error)
+    {
+        boost::signals2::scoped_connection conn;
+        if(!_doc_update_push.connected()) {
+            throw std::runtime_error("couldn't execute update command, database not ready");
+        } else if(_doc_update_push.blocked()) {
+            conn = this->document_changed.connect(std::bind(&basic_ddp_collection::commit_update, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+        }
+        return collection_t::update_many(updates);
+    }
+
+    template<typename collection_t>
+    int basic_ddp_collection<collection_t>::remove_many(std::vector<nlohmann::json::object_t> const& selectors) throw(std::runtime_error)
+    {
+        boost::signals2::scoped_connection conn;
+        if(!_doc_remove_push.connected()) {
+            throw std::runtime_error("couldn't execute remove command, database not ready");
+        } else if(_doc_remove_push.blocked()) {
+            conn = this->document_removed.connect(std::bind(&basic_ddp_collection::commit_remove, this, std::placeholders::_1));
+        }
+        return collection_t::remove_many(selectors);
+    }
+
+    template<typename collection_t>
+    void basic_ddp_collection<collection_t>::on_ready(typename ready_signal::slot_type const& slot)
     {
         _ready_sig.connect_extended([=](boost::signals2::connection const& conn) {
             slot();
@@ -84,18 +126,35 @@ namespace meteorpp {
         });
     }
 
-    void ddp_collection::init_ddp_collection(std::string const& name, nlohmann::json::array_t const& params) throw(websocketpp::exception)
+    template<typename collection_t>
+    void basic_ddp_collection<collection_t>::init_ddp_collection(std::string const& name, nlohmann::json::array_t const& params) throw(std::runtime_error, websocketpp::exception)
     {
-        _ddp->on_document_added(std::bind(&ddp_collection::on_document_added, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
-        _ddp->on_document_changed(std::bind(&ddp_collection::on_document_changed, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::placeholders::_4));
-        _ddp->on_document_removed(std::bind(&ddp_collection::on_document_removed, this, std::placeholders::_1, std::placeholders::_2));
+        mark_stale();
+
+        _ddp->on_reconnected(std::bind(&basic_ddp_collection::on_reconnected, this, std::placeholders::_1));
+        _ddp->on_document_added(std::bind(&basic_ddp_collection::on_document_added, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+        _ddp->on_document_changed(std::bind(&basic_ddp_collection::on_document_changed, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::placeholders::_4));
+        _ddp->on_document_removed(std::bind(&basic_ddp_collection::on_document_removed, this, std::placeholders::_1, std::placeholders::_2));
         _ddp->on_synchronized([&](std::string const& method_id) {
             _idle.left.erase(method_id);
         });
-        _subscription = _ddp->subscribe(name, params, std::bind(&ddp_collection::on_initial_batch, this, std::placeholders::_1));
+        _subscription = _ddp->subscribe(name, params, std::bind(&basic_ddp_collection::on_initial_batch, this, std::placeholders::_1), [](std::string const& id, nlohmann::json const& error) {
+            std::cerr << error << std::endl;
+        });
+    }
+
+    template<typename collection_t>
+    void basic_ddp_collection<collection_t>::mark_stale()
+    {
+        find_options ids_only;
+        ids_only.fields = {{ "_id", 1 }};
+        for(auto const& document: collection_t::find(nlohmann::json::object(), ids_only)) {
+            _stale.insert(document.at("_id").template get<std::string>());
+        }
     }
 
-    void ddp_collection::commit_insert(std::string const& id, nlohmann::json::object_t const& fields)
+    template<typename collection_t>
+    void basic_ddp_collection<collection_t>::commit_insert(std::string const& id, nlohmann::json::object_t const& fields)
     {
         nlohmann::json doc_with_id = fields;
         doc_with_id["_id"] = {{ "$type", "oid"}, { "$value", id }};
@@ -108,7 +167,8 @@ namespace meteorpp {
         _idle.left.insert(std::make_pair(method_id, id));
     }
 
-    void ddp_collection::commit_update(std::string const& id, nlohmann::json::object_t const& fields, std::vector<std::string> const& cleared)
+    template<typename collection_t>
+    void basic_ddp_collection<collection_t>::commit_update(std::string const& id, nlohmann::json::object_t const& fields, std::vector<std::string> const& cleared)
     {
         nlohmann::json selector;
         selector["_id"] = {{ "$type", "oid"}, { "$value", id }};
@@ -132,7 +192,8 @@ namespace meteorpp {
         _idle.left.insert(std::make_pair(method_id, id));
     }
 
-    void ddp_collection::commit_remove(std::string const& id)
+    template<typename collection_t>
+    void basic_ddp_collection<collection_t>::commit_remove(std::string const& id)
     {
         nlohmann::json selector;
         selector["_id"] = {{ "$type", "oid"}, { "$value", id }};
@@ -144,54 +205,94 @@ namespace meteorpp {
         _idle.left.insert(std::make_pair(method_id, id));
     }
 
-    void ddp_collection::on_initial_batch(std::string const& subscription)
+    template<typename collection_t>
+    void basic_ddp_collection<collection_t>::on_initial_batch(std::string const& subscription)
     {
-        _doc_insert_push = document_added.connect(std::bind(&ddp_collection::commit_insert, this, std::placeholders::_1, std::placeholders::_2));
-        _doc_update_push = document_changed.connect(std::bind(&ddp_collection::commit_update, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
-        _doc_remove_push = document_removed.connect(std::bind(&ddp_collection::commit_remove, this, std::placeholders::_1));
+        if(!_stale.empty()) {
+            std::vector<nlohmann::json::object_t> selectors;
+            for(auto const& id: _stale) {
+                selectors.push_back({{ "_id", id }});
+            }
+            _stale.clear();
+            collection_t::remove_many(selectors);
+        }
+        _doc_insert_push = this->document_added.connect(std::bind(&basic_ddp_collection::commit_insert, this, std::placeholders::_1, std::placeholders::_2));
+        _doc_update_push = this->document_changed.connect(std::bind(&basic_ddp_collection::commit_update, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+        _doc_remove_push = this->document_removed.connect(std::bind(&basic_ddp_collection::commit_remove, this, std::placeholders::_1));
         _ready_sig();
     }
 
-    void ddp_collection::on_document_added(std::string const& collection, std::string const& id, nlohmann::json::object_t const& fields)
+    template<typename collection_t>
+    void basic_ddp_collection<collection_t>::on_reconnected(std::string const& session)
+    {
+        _doc_insert_push.disconnect();
+        _doc_update_push.disconnect();
+        _doc_remove_push.disconnect();
+        _idle.clear();
+        mark_stale();
+    }
+
+    template<typename collection_t>
+    void basic_ddp_collection<collection_t>::on_document_added(std::string const& collection, std::string const& id, nlohmann::json::object_t const& fields)
     {
         if(collection == _name) {
             boost::signals2::shared_connection_block block(_doc_insert_push);
+            bool const stale = _stale.erase(id) > 0;
             if(_idle.right.find(id) == _idle.right.end()) {
                 nlohmann::json document = fields;
                 document["_id"] = id;
-                collection::insert(document);
+                if(!stale) {
+                    collection_t::insert(document);
+                } else {
+                    auto const diff = collection_t::modified_fields(collection_t::find_one({{ "_id", id }}), document);
+                    merge_document(id, diff["fields"], diff["cleared"]);
+                }
             }
         }
     }
 
-    void ddp_collection::on_document_changed(std::string const& collection, std::string const& id, nlohmann::json::object_t const& fields, std::vector<std::string> const& cleared)
+    template<typename collection_t>
+    void basic_ddp_collection<collection_t>::on_document_changed(std::string const& collection, std::string const& id, nlohmann::json::object_t const& fields, std::vector<std::string> const& cleared)
     {
         if(collection == _name) {
             boost::signals2::shared_connection_block block(_doc_update_push);
             if(_idle.right.find(id) == _idle.right.end()) {
-                nlohmann::json modifier;
-                if(!fields.empty()) {
-                    modifier["$set"] = fields;
-                }
-                if(!cleared.empty()) {
-                    nlohmann::json::object_t unset_fields;
-                    for(auto const& cleared_field: cleared) {
-                        unset_fields[cleared_field] = true;
-                    }
-                    modifier["$unset"] = unset_fields;
-                }
-                collection::update({{ "_id", id }}, modifier);
+                merge_document(id, fields, cleared);
             }
         }
     }
 
-    void ddp_collection::on_document_removed(std::string const& collection, std::string const& id)
+    template<typename collection_t>
+    void basic_ddp_collection<collection_t>::on_document_removed(std::string const& collection, std::string const& id)
     {
         if(collection == _name) {
             boost::signals2::shared_connection_block block(_doc_remove_push);
             if(_idle.right.find(id) == _idle.right.end()) {
-                collection::remove({{ "_id", id }});
+                collection_t::remove({{ "_id", id }});
+            }
+        }
+    }
+
+    template<typename collection_t>
+    void basic_ddp_collection<collection_t>::merge_document(std::string const& id, nlohmann::json::object_t const& fields, std::vector<std::string> const& cleared)
+    {
+        nlohmann::json modifier;
+        if(!fields.empty()) {
+            modifier["$set"] = fields;
+        }
+        if(!cleared.empty()) {
+            nlohmann::json::object_t unset_fields;
+            for(auto const& cleared_field: cleared) {
+                unset_fields[cleared_field] = true;
             }
+            modifier["$unset"] = unset_fields;
+        }
+        if(!modifier.empty()) {
+            collection_t::update({{ "_id", id }}, modifier);
         }
     }
+
+    template class basic_ddp_collection<collection>;
+
+    template class basic_ddp_collection<memory_collection>;
 }
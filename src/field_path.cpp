@@ -0,0 +1,201 @@
+/*
+ * Copyright (c) 2015, Mario Flach. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include <limits>
+
+#include "../include/meteorpp/field_path.hpp"
+
+namespace meteorpp {
+    namespace {
+        /* Parses a segment addressing an array element, returns false if it is not a number or too large.
+         */
+        bool parse_index(std::string const& segment, std::size_t& index)
+        {
+            if(segment.empty() || segment.size() > std::numeric_limits<std::size_t>::digits10) {
+                return false;
+            }
+            index = 0;
+            for(auto const c: segment) {
+                if(c < '0' || c > '9') {
+                    return false;
+                }
+                index = index * 10 + static_cast<std::size_t>(c - '0');
+            }
+            return true;
+        }
+
+        nlohmann::json const* child(nlohmann::json const& parent, std::string const& segment)
+        {
+            std::size_t index;
+            if(parent.is_object()) {
+                auto const it = parent.find(segment);
+                return it != parent.end() ? &*it : nullptr;
+            } else if(parent.is_array() && parse_index(segment, index)) {
+                return index < parent.size() ? &parent[index] : nullptr;
+            }
+            return nullptr;
+        }
+
+        nlohmann::json* child(nlohmann::json& parent, std::string const& segment, bool create)
+        {
+            std::size_t index;
+            if(parent.is_null() && create) {
+                parent = nlohmann::json::object();
+            }
+            if(parent.is_object()) {
+                auto const it = parent.find(segment);
+                if(it != parent.end()) {
+                    return &*it;
+                }
+                return create ? &parent[segment] : nullptr;
+            } else if(parent.is_array() && parse_index(segment, index)) {
+                if(index >= parent.size()) {
+                    if(!create) {
+                        return nullptr;
+                    }
+                    while(parent.size() <= index) {
+                        parent.push_back(nullptr);
+                    }
+                }
+                return &parent[index];
+            } else if(create) {
+                throw std::invalid_argument("couldn't create field '" + segment + "' in a non-object value");
+            }
+            return nullptr;
+        }
+    }
+
+    field_path::field_path(std::string const& path)
+        : _path(path)
+    {
+        std::size_t start = 0, end;
+        while((end = path.find('.', start)) != std::string::npos) {
+            _segments.push_back(path.substr(start, end - start));
+            start = end + 1;
+        }
+        _segments.push_back(path.substr(start));
+    }
+
+    std::string const& field_path::str() const
+    {
+        return _path;
+    }
+
+    std::vector<std::string> const& field_path::segments() const
+    {
+        return _segments;
+    }
+
+    nlohmann::json const* field_path::find(nlohmann::json::object_t const& document) const
+    {
+        auto const it = document.find(_segments.front());
+        if(it == document.end()) {
+            return nullptr;
+        }
+
+        nlohmann::json const* value = &it->second;
+        for(std::size_t i = 1; value && i < _segments.size(); ++i) {
+            value = child(*value, _segments[i]);
+        }
+        return value;
+    }
+
+    nlohmann::json* field_path::find(nlohmann::json::object_t& document, bool create) const throw(std::invalid_argument)
+    {
+        auto it = document.find(_segments.front());
+        if(it == document.end()) {
+            if(!create) {
+                return nullptr;
+            }
+            it = document.emplace(_segments.front(), nullptr).first;
+        }
+
+        nlohmann::json* value = &it->second;
+        for(std::size_t i = 1; value && i < _segments.size(); ++i) {
+            value = child(*value, _segments[i], create);
+        }
+        return value;
+    }
+
+    void field_path::resolve(nlohmann::json::object_t const& document, std::vector<nlohmann::json const*>& values) const
+    {
+        auto const it = document.find(_segments.front());
+        if(it != document.end()) {
+            resolve(it->second, 1, values);
+        }
+    }
+
+    void field_path::resolve(nlohmann::json const& value, std::size_t segment, std::vector<nlohmann::json const*>& values) const
+    {
+        if(segment == _segments.size()) {
+            values.push_back(&value);
+        } else if(value.is_object()) {
+            auto const it = value.find(_segments[segment]);
+            if(it != value.end()) {
+                resolve(*it, segment + 1, values);
+            }
+        } else if(value.is_array()) {
+            std::size_t index;
+            if(parse_index(_segments[segment], index)) {
+                if(index < value.size()) {
+                    resolve(value[index], segment + 1, values);
+                }
+            } else {
+                for(auto const& element: value) {
+                    if(element.is_object()) {
+                        resolve(element, segment, values);
+                    }
+                }
+            }
+        }
+    }
+
+    bool field_path::erase(nlohmann::json::object_t& document) const
+    {
+        if(_segments.size() == 1) {
+            return document.erase(_segments.front()) > 0;
+        }
+
+        auto const it = document.find(_segments.front());
+        if(it == document.end()) {
+            return false;
+        }
+
+        nlohmann::json* parent = &it->second;
+        for(std::size_t i = 1; parent && i + 1 < _segments.size(); ++i) {
+            parent = child(*parent, _segments[i], false);
+        }
+        std::size_t index;
+        if(!parent) {
+            return false;
+        } else if(parent->is_object()) {
+            return parent->erase(_segments.back()) > 0;
+        } else if(parent->is_array() && parse_index(_segments.back(), index)) {
+            if(index < parent->size()) {
+                (*parent)[index] = nullptr;
+                return true;
+            }
+        }
+        return false;
+    }
+}
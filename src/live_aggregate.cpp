@@ -0,0 +1,229 @@
+/*
+ * Copyright (c) 2015, Mario Flach. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include <cmath>
+
+#include "../include/meteorpp/live_aggregate.hpp"
+
+namespace meteorpp {
+    namespace {
+        void add_number(live_aggregate::totals& totals, nlohmann::json const& value, int sign)
+        {
+            if(!value.is_number_float()) {
+                totals.integer_sum += sign * value.get<std::int64_t>();
+                return;
+            }
+
+            auto const x = sign * value.get<double>();
+            auto const sum = totals.float_sum + x;
+            if(std::abs(totals.float_sum) >= std::abs(x)) {
+                totals.compensation += (totals.float_sum - sum) + x;
+            } else {
+                totals.compensation += (x - sum) + totals.float_sum;
+            }
+            totals.float_sum = sum;
+            if(sign > 0) {
+                ++totals.float_count;
+            } else {
+                --totals.float_count;
+            }
+            if(totals.float_count == 0) {
+                totals.float_sum = 0;
+                totals.compensation = 0;
+            }
+        }
+
+        void add_value(live_aggregate::totals& totals, nlohmann::json const* value)
+        {
+            ++totals.count;
+            if(value && !value->is_null()) {
+                if(value->is_number()) {
+                    add_number(totals, *value, 1);
+                }
+                totals.values.insert(*value);
+            }
+        }
+
+        void remove_value(live_aggregate::totals& totals, nlohmann::json const* value)
+        {
+            --totals.count;
+            if(value && !value->is_null()) {
+                if(value->is_number()) {
+                    add_number(totals, *value, -1);
+                }
+                auto const it = totals.values.find(*value);
+                if(it != totals.values.end()) {
+                    totals.values.erase(it);
+                }
+            }
+        }
+    }
+
+    nlohmann::json live_aggregate::totals::min() const
+    {
+        return values.empty() ? nlohmann::json() : *values.begin();
+    }
+
+    nlohmann::json live_aggregate::totals::max() const
+    {
+        return values.empty() ? nlohmann::json() : *values.rbegin();
+    }
+
+    nlohmann::json live_aggregate::totals::sum() const
+    {
+        if(float_count == 0) {
+            return integer_sum;
+        }
+        return static_cast<double>(integer_sum) + (float_sum + compensation);
+    }
+
+    live_aggregate::live_aggregate(nlohmann::json::object_t const& selector, std::string const& field, std::string const& group_by, std::shared_ptr<collection_base> const& collection) throw(std::runtime_error)
+        : _field(field), _group_by(group_by.empty() ? nullptr : new field_path(group_by)), _coll(collection), _matcher(collection->matcher(selector))
+    {
+        for(auto const& document: _coll->find(selector)) {
+            add(document);
+        }
+        _coll->_router.add(this, selector);
+    }
+
+    live_aggregate::~live_aggregate()
+    {
+        _coll->_router.remove(this);
+    }
+
+    live_aggregate::totals const& live_aggregate::total() const
+    {
+        return _total;
+    }
+
+    std::map<nlohmann::json, live_aggregate::totals> const& live_aggregate::groups() const
+    {
+        return _groups;
+    }
+
+    boost::signals2::connection live_aggregate::on_changed(updated_signal::slot_type const& slot)
+    {
+        return _updated_sig.connect(slot);
+    }
+
+    void live_aggregate::document_added(std::string const& id, nlohmann::json::object_t const& fields)
+    {
+        auto document = fields;
+        document["_id"] = id;
+        if(add_document(document)) {
+            _updated_sig();
+        }
+    }
+
+    void live_aggregate::document_changed(std::string const& id, nlohmann::json::object_t const& before, nlohmann::json::object_t const& after)
+    {
+        if(change_document(before, after)) {
+            _updated_sig();
+        }
+    }
+
+    void live_aggregate::document_removed(std::string const& id, nlohmann::json::object_t const& document)
+    {
+        if(remove_document(document)) {
+            _updated_sig();
+        }
+    }
+
+    void live_aggregate::apply_batch(std::vector<live_query_router::change const*> const& changes)
+    {
+        bool updated = false;
+        for(auto const* change: changes) {
+            switch(change->type) {
+                case live_query_router::change::kind::added:
+                    updated = add_document(*change->after) || updated;
+                    break;
+                case live_query_router::change::kind::changed:
+                    updated = change_document(*change->before, *change->after) || updated;
+                    break;
+                case live_query_router::change::kind::removed:
+                    updated = remove_document(*change->before) || updated;
+                    break;
+            }
+        }
+        if(updated) {
+            _updated_sig();
+        }
+    }
+
+    bool live_aggregate::add_document(nlohmann::json::object_t const& document)
+    {
+        if(!_matcher(document)) {
+            return false;
+        }
+        add(document);
+        return true;
+    }
+
+    bool live_aggregate::change_document(nlohmann::json::object_t const& before, nlohmann::json::object_t const& after)
+    {
+        bool const matched = _matcher(before);
+        bool const matches = _matcher(after);
+        if(matched) {
+            remove(before);
+        }
+        if(matches) {
+            add(after);
+        }
+        return matched || matches;
+    }
+
+    bool live_aggregate::remove_document(nlohmann::json::object_t const& document)
+    {
+        if(!_matcher(document)) {
+            return false;
+        }
+        remove(document);
+        return true;
+    }
+
+    void live_aggregate::add(nlohmann::json::object_t const& document)
+    {
+        auto const* value = _field.find(document);
+        add_value(_total, value);
+        if(_group_by) {
+            auto const* key = _group_by->find(document);
+            add_value(_groups[key ? *key : nlohmann::json()], value);
+        }
+    }
+
+    void live_aggregate::remove(nlohmann::json::object_t const& document)
+    {
+        auto const* value = _field.find(document);
+        remove_value(_total, value);
+        if(_group_by) {
+            auto const* key = _group_by->find(document);
+            auto const group = _groups.find(key ? *key : nlohmann::json());
+            if(group != _groups.end()) {
+                remove_value(group->second, value);
+                if(group->second.count == 0) {
+                    _groups.erase(group);
+                }
+            }
+        }
+    }
+}
@@ -21,28 +21,108 @@
  *
  */
 
-#include <ejdb/ejdb.h>
-#include <ejdb/ejdb_private.h>
+#include <algorithm>
 
+#include "../include/meteorpp/field_path.hpp"
 #include "../include/meteorpp/live_query.hpp"
+#include "../include/meteorpp/live_query_multiplexer.hpp"
 
 namespace meteorpp {
-    live_query::live_query(nlohmann::json::object_t const& selector, std::shared_ptr<collection> const& collection) throw(std::runtime_error)
-        : _selector(collection::convert_to_bson(selector)), _coll(collection)
+    namespace {
+        bool is_below(std::string const& path, std::string const& parent)
+        {
+            return path.size() > parent.size() && path[parent.size()] == '.' && path.compare(0, parent.size(), parent) == 0;
+        }
+
+        /* Returns the value of the nearest parent of path which is set to an object, along with the path relative to it.
+         */
+        nlohmann::json* find_parent(nlohmann::json::object_t& fields, std::string const& path, std::string& rest)
+        {
+            for(auto dot = path.find('.'); dot != std::string::npos; dot = path.find('.', dot + 1)) {
+                auto const it = fields.find(path.substr(0, dot));
+                if(it != fields.end() && it->second.is_object()) {
+                    rest = path.substr(dot + 1);
+                    return &it->second;
+                }
+            }
+            return nullptr;
+        }
+
+        /* Drops the pending sets and unsets of path and of the fields below it, which a new change to path supersedes.
+         */
+        void forget_paths(std::pair<nlohmann::json::object_t, std::vector<std::string>>& changed, std::string const& path)
+        {
+            for(auto it = changed.first.lower_bound(path); it != changed.first.end() && it->first.compare(0, path.size(), path) == 0;) {
+                if(it->first == path || is_below(it->first, path)) {
+                    it = changed.first.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+            changed.second.erase(std::remove_if(changed.second.begin(), changed.second.end(), [&](std::string const& cleared) { return cleared == path || is_below(cleared, path); }), changed.second.end());
+        }
+    }
+
+    nlohmann::json live_query::snapshot::data() const
+    {
+        nlohmann::json data = nlohmann::json::array();
+        for(auto const& document: documents) {
+            data.push_back(*document);
+        }
+        return data;
+    }
+
+    live_query::live_query(nlohmann::json::object_t const& selector, std::shared_ptr<collection_base> const& collection) throw(std::runtime_error)
+        : live_query(selector, find_options(), collection)
+    {
+    }
+
+    live_query::live_query(nlohmann::json::object_t const& selector, find_options const& options, std::shared_ptr<collection_base> const& collection) throw(std::runtime_error)
+        : _multiplexer(collection->multiplex(selector, options)), _handle(_multiplexer->add_handle(this))
     {
-        _coll->document_added.connect(std::bind(&live_query::document_added, this, std::placeholders::_1, std::placeholders::_2));
-        _coll->document_pre_changed.connect(std::bind(&live_query::document_changed, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
-        _coll->document_pre_removed.connect(std::bind(&live_query::document_removed, this, std::placeholders::_1, std::placeholders::_2));
-        _results = _coll->find(selector);
     }
 
     live_query::~live_query()
     {
+        _multiplexer->remove_handle(_handle);
     }
 
     nlohmann::json const& live_query::data() const
     {
-        return _results;
+        return _multiplexer->data();
+    }
+
+    live_query::document_range live_query::documents() const
+    {
+        return _multiplexer->documents();
+    }
+
+    std::shared_ptr<live_query::snapshot const> live_query::current_snapshot() const
+    {
+        return _multiplexer->current_snapshot();
+    }
+
+    std::size_t live_query::size() const
+    {
+        return _multiplexer->size();
+    }
+
+    nlohmann::json::object_t const* live_query::find(std::string const& id) const
+    {
+        return _multiplexer->find(id);
+    }
+
+    bool live_query::change_set::empty() const
+    {
+        return added.empty() && changed.empty() && removed.empty();
+    }
+
+    void live_query::coalesce(boost::asio::io_service& io_service, boost::posix_time::time_duration const& window)
+    {
+        _io_service = &io_service;
+        _window = window;
+        _timer.reset(new boost::asio::deadline_timer(io_service));
+        _flush_scheduled = false;
     }
 
     boost::signals2::connection live_query::on_changed(updated_signal::slot_type const& slot)
@@ -50,69 +130,161 @@ namespace meteorpp {
         return _updated_sig.connect(slot);
     }
 
-    boost::signals2::connection live_query::on_document_added(collection::document_added_signal::slot_type const& slot)
+    boost::signals2::connection live_query::on_changes(changes_signal::slot_type const& slot)
+    {
+        return _changes_sig.connect(slot);
+    }
+
+    boost::signals2::connection live_query::on_document_added(collection_base::document_added_signal::slot_type const& slot)
     {
         return _doc_added_sig.connect(slot);
     }
 
-    boost::signals2::connection live_query::on_document_changed(collection::document_changed_signal::slot_type const& slot)
+    boost::signals2::connection live_query::on_document_changed(collection_base::document_changed_signal::slot_type const& slot)
     {
         return _doc_changed_sig.connect(slot);
     }
 
-    boost::signals2::connection live_query::on_document_removed(collection::document_removed_signal::slot_type const& slot)
+    boost::signals2::connection live_query::on_document_removed(collection_base::document_removed_signal::slot_type const& slot)
     {
         return _doc_removed_sig.connect(slot);
     }
 
-    void live_query::document_added(std::string const& id, nlohmann::json::object_t const& fields)
+    boost::signals2::connection live_query::on_document_added_before(document_added_before_signal::slot_type const& slot)
     {
-        auto document = fields;
-        document["_id"] = id;
-        if(match(document)) {
-            _results.push_back(document);
-            _doc_added_sig(id, fields);
-            _updated_sig();
-        }
+        return _doc_added_before_sig.connect(slot);
+    }
+
+    boost::signals2::connection live_query::on_document_moved_before(document_moved_before_signal::slot_type const& slot)
+    {
+        return _doc_moved_before_sig.connect(slot);
+    }
+
+    boost::signals2::connection live_query::on_document_added_at(document_added_at_signal::slot_type const& slot)
+    {
+        return _doc_added_at_sig.connect(slot);
+    }
+
+    boost::signals2::connection live_query::on_document_changed_at(document_changed_at_signal::slot_type const& slot)
+    {
+        return _doc_changed_at_sig.connect(slot);
+    }
+
+    boost::signals2::connection live_query::on_document_moved_to(document_moved_to_signal::slot_type const& slot)
+    {
+        return _doc_moved_to_sig.connect(slot);
+    }
+
+    boost::signals2::connection live_query::on_document_removed_at(document_removed_at_signal::slot_type const& slot)
+    {
+        return _doc_removed_at_sig.connect(slot);
+    }
+
+    void live_query::document_added(std::string const& id, nlohmann::json::object_t const& fields, std::string const& before, std::size_t index)
+    {
+        _doc_added_sig(id, fields);
+        _doc_added_before_sig(id, fields, before);
+        _doc_added_at_sig(id, fields, index);
+
+        _changes.changed.erase(id);
+        _changes.added[id] = fields;
     }
 
-    void live_query::document_changed(std::string const& id, nlohmann::json::object_t const& before, nlohmann::json::object_t const& after)
+    void live_query::document_changed(std::string const& id, nlohmann::json::object_t const& fields, std::vector<std::string> const& cleared, std::size_t index)
     {
-        if(match(before)) {
-            if(match(after)) {
-                *std::find_if(_results.begin(), _results.end(),[id](nlohmann::json const& result) {
-                    return result["_id"] == id;
-                }) = after;
-                auto const diff = collection::modified_fields(before, after);
-                _doc_changed_sig(id, diff["fields"], diff["cleared"]);
+        _doc_changed_sig(id, fields, cleared);
+        _doc_changed_at_sig(id, fields, cleared, index);
+
+        auto const added = _changes.added.find(id);
+        if(added != _changes.added.end()) {
+            for(auto const& field: fields) {
+                *field_path(field.first).find(added->second, true) = field.second;
+            }
+            for(auto const& field: cleared) {
+                field_path(field).erase(added->second);
+            }
+            return;
+        }
+
+        auto& changed = _changes.changed[id];
+        for(auto const& field: fields) {
+            std::string rest;
+            if(auto* parent = find_parent(changed.first, field.first, rest)) {
+                *field_path(rest).find(parent->get_ref<nlohmann::json::object_t&>(), true) = field.second;
+                continue;
+            }
+            forget_paths(changed, field.first);
+            auto const cleared_parent = std::find_if(changed.second.begin(), changed.second.end(), [&](std::string const& path) { return is_below(field.first, path); });
+            if(cleared_parent != changed.second.end()) {
+                nlohmann::json::object_t value;
+                *field_path(field.first.substr(cleared_parent->size() + 1)).find(value, true) = field.second;
+                changed.first[*cleared_parent] = value;
+                changed.second.erase(cleared_parent);
             } else {
-                _results.erase(std::remove_if(_results.begin(), _results.end(), [id](nlohmann::json const& result) {
-                    return result["_id"] == id;
-                }), _results.end());
-                _doc_removed_sig(id);
+                changed.first[field.first] = field.second;
             }
-        } else if(match(after)) {
-            _results.push_back(after);
-            auto fields = after;
-            fields.erase("_id");
-            _doc_added_sig(id, fields);
         }
-        _updated_sig();
+        for(auto const& field: cleared) {
+            std::string rest;
+            if(auto* parent = find_parent(changed.first, field, rest)) {
+                field_path(rest).erase(parent->get_ref<nlohmann::json::object_t&>());
+            } else if(std::none_of(changed.second.begin(), changed.second.end(), [&](std::string const& path) { return path == field || is_below(field, path); })) {
+                forget_paths(changed, field);
+                changed.second.push_back(field);
+            }
+        }
+    }
+
+    void live_query::document_moved(std::string const& id, std::string const& before, std::size_t from, std::size_t to)
+    {
+        _doc_moved_before_sig(id, before);
+        _doc_moved_to_sig(id, from, to);
     }
 
-    void live_query::document_removed(std::string const& id, nlohmann::json::object_t const& document)
+    void live_query::document_removed(std::string const& id, std::size_t index)
     {
-        if(match(document)) {
-            _results.erase(std::remove_if(_results.begin(), _results.end(), [id](nlohmann::json const& result) {
-                return result["_id"] == id;
-            }), _results.end());
-            _doc_removed_sig(id);
-            _updated_sig();
+        _doc_removed_sig(id);
+        _doc_removed_at_sig(id, index);
+
+        _changes.changed.erase(id);
+        if(_changes.added.erase(id) == 0) {
+            _changes.removed.insert(id);
         }
     }
 
-    bool live_query::match(nlohmann::json::object_t const& document)
+    void live_query::notify_updated()
     {
-        return ejdbqrymatch(std::shared_ptr<EJQ>(ejdbcreatequery2(_coll->_db.get(), bson_data(_selector.get())), ejdbquerydel).get(), collection::convert_to_bson(document).get());
+        if(!_io_service) {
+            flush();
+        } else if(!_flush_scheduled) {
+            _flush_scheduled = true;
+            std::weak_ptr<void> const lifetime = _lifetime;
+            auto const handler = [this, lifetime]() {
+                if(!lifetime.expired()) {
+                    _flush_scheduled = false;
+                    flush();
+                }
+            };
+            if(_window <= boost::posix_time::time_duration()) {
+                _io_service->post(handler);
+            } else {
+                _timer->expires_from_now(_window);
+                _timer->async_wait([handler](boost::system::error_code const& error) {
+                    if(!error) {
+                        handler();
+                    }
+                });
+            }
+        }
+    }
+
+    void live_query::flush()
+    {
+        change_set changes;
+        std::swap(changes, _changes);
+        _updated_sig();
+        if(!changes.empty()) {
+            _changes_sig(changes);
+        }
     }
 }
@@ -0,0 +1,441 @@
+/*
+ * Copyright (c) 2015, Mario Flach. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include <algorithm>
+
+#include <boost/range/adaptor/transformed.hpp>
+
+#include "../include/meteorpp/field_path.hpp"
+#include "../include/meteorpp/live_query.hpp"
+#include "../include/meteorpp/live_query_multiplexer.hpp"
+
+namespace meteorpp {
+    live_query_multiplexer::live_query_multiplexer(std::string const& key, nlohmann::json::object_t const& selector, find_options const& options, std::shared_ptr<collection_base> const& collection) throw(std::runtime_error)
+        : _key(key), _selector(selector), _result_order(result_ranking::ctor_args_list(boost::make_tuple(boost::multi_index::identity<result_list::iterator>(), result_order{ sort_order(options.sort) }))), _coll(collection), _matcher(collection->matcher(selector))
+    {
+        if(options.skip > 0) {
+            throw std::runtime_error("couldn't track query, skip is not supported by live queries");
+        }
+        _options.sort = options.sort;
+        _options.limit = options.limit;
+        auto const by_id = std::find_if(_options.sort.begin(), _options.sort.end(), [](std::pair<std::string, int> const& key) { return key.first == "_id"; });
+        if(!_options.sort.empty() && by_id == _options.sort.end()) {
+            _options.sort.emplace_back("_id", 1);
+        }
+
+        for(auto const& document: _coll->find(selector, _options)) {
+            place_result(document.at("_id"), std::make_shared<nlohmann::json::object_t const>(document));
+        }
+
+        std::vector<persistent_sequence::value_type> documents;
+        documents.reserve(_results.size());
+        for(auto const& result: _results) {
+            documents.push_back(result.document);
+        }
+        _sequence = persistent_sequence(documents);
+        _published = _sequence;
+        _snapshot = std::make_shared<live_query::snapshot const>(live_query::snapshot{ 0, _sequence });
+        _coll->_router.add(this, selector);
+    }
+
+    live_query_multiplexer::~live_query_multiplexer()
+    {
+        _coll->_router.remove(this);
+
+        auto const registered = _coll->_multiplexers.find(_key);
+        if(registered != _coll->_multiplexers.end() && registered->second.expired()) {
+            _coll->_multiplexers.erase(registered);
+        }
+    }
+
+    nlohmann::json const& live_query_multiplexer::data() const
+    {
+        if(!_data_valid) {
+            _data = nlohmann::json::array();
+            for(auto const& document: _results) {
+                _data.push_back(*document.document);
+            }
+            _data_valid = true;
+        }
+        return _data;
+    }
+
+    live_query::document_range live_query_multiplexer::documents() const
+    {
+        return _results | boost::adaptors::transformed(&live_query_multiplexer::result_document);
+    }
+
+    std::size_t live_query_multiplexer::size() const
+    {
+        return _results.size();
+    }
+
+    nlohmann::json::object_t const* live_query_multiplexer::find(std::string const& id) const
+    {
+        auto const it = _result_index.find(id);
+        return it != _result_index.end() ? it->second->document.get() : nullptr;
+    }
+
+    std::shared_ptr<live_query::snapshot const> live_query_multiplexer::current_snapshot() const
+    {
+        std::lock_guard<std::mutex> const lock(_snapshot_mutex);
+        if(_publish_pending) {
+            _snapshot = std::make_shared<live_query::snapshot const>(live_query::snapshot{ _snapshot->version + 1, _published });
+            _publish_pending = false;
+        }
+        return _snapshot;
+    }
+
+    std::string live_query_multiplexer::key(nlohmann::json::object_t const& selector, find_options const& options)
+    {
+        return nlohmann::json({ selector, options.sort, options.limit }).dump();
+    }
+
+    std::uint64_t live_query_multiplexer::add_handle(live_query* handle)
+    {
+        _handles.emplace(_next_handle, handle);
+        return _next_handle++;
+    }
+
+    void live_query_multiplexer::remove_handle(std::uint64_t handle)
+    {
+        _handles.erase(handle);
+    }
+
+    void live_query_multiplexer::notify_updated()
+    {
+        publish();
+        for_each_handle([](live_query& handle) { handle.notify_updated(); });
+    }
+
+    void live_query_multiplexer::publish()
+    {
+        std::lock_guard<std::mutex> const lock(_snapshot_mutex);
+        _published = _sequence;
+        _publish_pending = true;
+    }
+
+    void live_query_multiplexer::for_each_handle(std::function<void(live_query&)> const& notify)
+    {
+        std::vector<std::uint64_t> handles;
+        handles.reserve(_handles.size());
+        for(auto const& handle: _handles) {
+            handles.push_back(handle.first);
+        }
+        for(auto const handle: handles) {
+            auto const it = _handles.find(handle);
+            if(it != _handles.end()) {
+                notify(*it->second);
+            }
+        }
+    }
+
+    void live_query_multiplexer::emit_added(std::string const& id, result_list::iterator it)
+    {
+        auto fields = *it->document;
+        fields.erase("_id");
+        auto const before = next_id(it);
+        auto const index = index_of(it);
+        for_each_handle([&](live_query& handle) { handle.document_added(id, fields, before, index); });
+    }
+
+    void live_query_multiplexer::emit_changed(std::string const& id, nlohmann::json::object_t const& before, nlohmann::json::object_t const& after, std::size_t index)
+    {
+        auto const diff = collection_base::modified_fields(before, after);
+        nlohmann::json::object_t const& fields = diff["fields"].get_ref<nlohmann::json::object_t const&>();
+        std::vector<std::string> const cleared = diff["cleared"];
+        for_each_handle([&](live_query& handle) { handle.document_changed(id, fields, cleared, index); });
+    }
+
+    void live_query_multiplexer::emit_moved(std::string const& id, std::string const& before, std::size_t from, std::size_t to)
+    {
+        for_each_handle([&](live_query& handle) { handle.document_moved(id, before, from, to); });
+    }
+
+    void live_query_multiplexer::emit_removed(std::string const& id, std::size_t index)
+    {
+        for_each_handle([&](live_query& handle) { handle.document_removed(id, index); });
+    }
+
+    nlohmann::json::object_t const& live_query_multiplexer::result_document(result const& r)
+    {
+        return *r.document;
+    }
+
+    bool live_query_multiplexer::result_order::operator()(result_list::iterator const& a, result_list::iterator const& b) const
+    {
+        return order.empty() ? a->sequence < b->sequence : precedes(*a->document, *b->document);
+    }
+
+    bool live_query_multiplexer::result_order::precedes(nlohmann::json::object_t const& a, nlohmann::json::object_t const& b) const
+    {
+        if(order(a, b)) {
+            return true;
+        } else if(order(b, a)) {
+            return false;
+        }
+        return a.at("_id") < b.at("_id");
+    }
+
+    void live_query_multiplexer::document_added(std::string const& id, nlohmann::json::object_t const& fields)
+    {
+        auto const self = shared_from_this();
+        auto document = fields;
+        document["_id"] = id;
+        if(add_document(id, std::make_shared<nlohmann::json::object_t const>(std::move(document)))) {
+            notify_updated();
+        }
+    }
+
+    void live_query_multiplexer::document_changed(std::string const& id, nlohmann::json::object_t const& before, nlohmann::json::object_t const& after)
+    {
+        auto const self = shared_from_this();
+        if(change_document(id, before, std::make_shared<nlohmann::json::object_t const>(after))) {
+            notify_updated();
+        }
+    }
+
+    void live_query_multiplexer::document_removed(std::string const& id, nlohmann::json::object_t const& document)
+    {
+        auto const self = shared_from_this();
+        if(remove_document(id)) {
+            notify_updated();
+        }
+    }
+
+    void live_query_multiplexer::apply_batch(std::vector<live_query_router::change const*> const& changes)
+    {
+        auto const self = shared_from_this();
+        bool updated = false;
+        _batching = true;
+        for(auto const* change: changes) {
+            switch(change->type) {
+                case live_query_router::change::kind::added:
+                    updated = add_document(change->id, change->after) || updated;
+                    break;
+                case live_query_router::change::kind::changed:
+                    updated = change_document(change->id, *change->before, change->after) || updated;
+                    break;
+                case live_query_router::change::kind::removed:
+                    updated = remove_document(change->id) || updated;
+                    break;
+            }
+        }
+        _batching = false;
+        if(_refill_pending) {
+            _refill_pending = false;
+            refill();
+        }
+        if(updated) {
+            notify_updated();
+        }
+    }
+
+    bool live_query_multiplexer::add_document(std::string const& id, std::shared_ptr<nlohmann::json::object_t const> const& document)
+    {
+        return _result_index.find(id) == _result_index.end() && match(*document) && admit(id, document);
+    }
+
+    bool live_query_multiplexer::change_document(std::string const& id, nlohmann::json::object_t const& before, std::shared_ptr<nlohmann::json::object_t const> const& after)
+    {
+        auto const it = _result_index.find(id);
+        bool const matches = match(*after);
+        if(it == _result_index.end()) {
+            return matches && admit(id, after);
+        } else if(!matches) {
+            emit_removed(id, erase_result(id));
+            refill();
+            return true;
+        }
+
+        auto const position = it->second;
+        auto const previous_next = next_id(position);
+        auto const previous_index = index_of(position);
+        if(!_options.sort.empty()) {
+            _result_order.erase(position);
+        }
+        position->document = after;
+        _data_valid = false;
+        if(_options.sort.empty()) {
+            _sequence = _sequence.replace(previous_index, after);
+        } else {
+            auto const ordered = _result_order.insert(position).first;
+            auto const next = std::next(ordered);
+            _results.splice(next != _result_order.end() ? *next : _results.end(), _results, position);
+            auto const current_index = _result_order.rank(ordered);
+            _sequence = current_index == previous_index ? _sequence.replace(current_index, after) : _sequence.erase(previous_index).insert(current_index, after);
+
+            if(_refill_pending && _results.size() < _options.limit && next == _result_order.end() && _result_order.key_comp().order(before, *after)) {
+                erase_result(id);
+                emit_removed(id, previous_index);
+                return true;
+            }
+            if(_options.limit > 0 && _results.size() == _options.limit && next == _result_order.end() && _result_order.key_comp().order(before, *after)) {
+                find_options first;
+                first.sort = _options.sort;
+                first.limit = 1;
+                auto const candidates = _coll->find(position != _results.begin() ? following(std::prev(position)) : _selector, first);
+                if(!candidates.empty() && candidates.front().at("_id") != id) {
+                    erase_result(id);
+                    emit_removed(id, previous_index);
+                    refill();
+                    return true;
+                }
+            }
+        }
+
+        emit_changed(id, before, *after, previous_index);
+        auto const current_next = next_id(position);
+        if(current_next != previous_next) {
+            emit_moved(id, current_next, previous_index, index_of(position));
+        }
+        return true;
+    }
+
+    bool live_query_multiplexer::remove_document(std::string const& id)
+    {
+        if(_result_index.find(id) == _result_index.end()) {
+            return false;
+        }
+        emit_removed(id, erase_result(id));
+        refill();
+        return true;
+    }
+
+    bool live_query_multiplexer::match(nlohmann::json::object_t const& document)
+    {
+        return _matcher(document);
+    }
+
+    bool live_query_multiplexer::admit(std::string const& id, std::shared_ptr<nlohmann::json::object_t const> const& document)
+    {
+        if(_options.limit > 0 && _results.size() >= _options.limit) {
+            if(_options.sort.empty() || !_result_order.key_comp().precedes(*document, *_results.back().document)) {
+                return false;
+            }
+            std::string const last = _results.back().document->at("_id");
+            emit_removed(last, erase_result(last));
+        } else if(_refill_pending && (_results.empty() || _options.sort.empty() || !_result_order.key_comp().precedes(*document, *_results.back().document))) {
+            return false;
+        }
+
+        emit_added(id, insert_result(id, document));
+        return true;
+    }
+
+    void live_query_multiplexer::refill()
+    {
+        if(_options.limit == 0 || _results.size() >= _options.limit) {
+            return;
+        } else if(_batching) {
+            _refill_pending = true;
+            return;
+        }
+
+        find_options next;
+        next.sort = _options.sort;
+        next.limit = _options.limit - _results.size();
+        for(auto const& document: _coll->find(!_results.empty() ? following(std::prev(_results.end())) : _selector, next)) {
+            std::string const id = document.at("_id");
+            if(_result_index.find(id) == _result_index.end()) {
+                emit_added(id, insert_result(id, std::make_shared<nlohmann::json::object_t const>(document)));
+            }
+        }
+    }
+
+    nlohmann::json::object_t live_query_multiplexer::following(result_list::iterator last) const
+    {
+        if(_options.sort.empty() || !_coll->selects_ranges_in_sort_order()) {
+            nlohmann::json ids = nlohmann::json::array();
+            for(auto it = _results.begin(); it != std::next(last); ++it) {
+                ids.push_back(it->document->at("_id"));
+            }
+            return {{ "$and", { _selector, {{ "_id", {{ "$nin", ids }} }} } }};
+        }
+
+        auto const& document = *last->document;
+
+        nlohmann::json after = nlohmann::json::array();
+        nlohmann::json::object_t equal;
+        for(auto const& key: _options.sort) {
+            auto const* value = field_path(key.first).find(document);
+            nlohmann::json const bound = value ? *value : nlohmann::json();
+            auto clause = equal;
+            if(!bound.is_null()) {
+                clause[key.first] = {{ key.second < 0 ? "$lt" : "$gt", bound }};
+                after.push_back(clause);
+            } else if(key.second >= 0) {
+                clause[key.first] = {{ "$ne", nullptr }};
+                after.push_back(clause);
+            }
+            equal[key.first] = bound;
+        }
+        return {{ "$and", { _selector, {{ "$or", after }} } }};
+    }
+
+    live_query_multiplexer::result_list::iterator live_query_multiplexer::insert_result(std::string const& id, std::shared_ptr<nlohmann::json::object_t const> const& document)
+    {
+        auto const it = place_result(id, document);
+        _sequence = _sequence.insert(index_of(it), document);
+        return it;
+    }
+
+    live_query_multiplexer::result_list::iterator live_query_multiplexer::place_result(std::string const& id, std::shared_ptr<nlohmann::json::object_t const> const& document)
+    {
+        auto const it = _results.insert(_results.end(), result{ document, _next_sequence++ });
+        auto const next = std::next(_result_order.insert(it).first);
+        if(next != _result_order.end()) {
+            _results.splice(*next, _results, it);
+        }
+        _result_index.emplace(id, it);
+        _data_valid = false;
+        return it;
+    }
+
+    std::size_t live_query_multiplexer::erase_result(std::string const& id)
+    {
+        auto const it = _result_index.find(id);
+        if(it == _result_index.end()) {
+            return _results.size();
+        }
+        auto const ranked = _result_order.find(it->second);
+        auto const index = _result_order.rank(ranked);
+        _result_order.erase(ranked);
+        _results.erase(it->second);
+        _result_index.erase(it);
+        _data_valid = false;
+        _sequence = _sequence.erase(index);
+        return index;
+    }
+
+    std::size_t live_query_multiplexer::index_of(result_list::iterator it) const
+    {
+        return _result_order.rank(_result_order.find(it));
+    }
+
+    std::string live_query_multiplexer::next_id(result_list::iterator it) const
+    {
+        auto const next = std::next(it);
+        return next != _results.end() ? next->document->at("_id").get<std::string>() : std::string();
+    }
+}
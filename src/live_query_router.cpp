@@ -0,0 +1,352 @@
+/*
+ * Copyright (c) 2015, Mario Flach. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include "../include/meteorpp/field_path.hpp"
+#include "../include/meteorpp/live_query_router.hpp"
+
+namespace meteorpp {
+    namespace {
+        bool is_routable_value(nlohmann::json const& value)
+        {
+            return !value.is_null() && !value.is_array();
+        }
+
+        bool is_operator_object(nlohmann::json const& spec)
+        {
+            for(auto it = spec.begin(); it != spec.end(); ++it) {
+                if(!it.key().empty() && it.key()[0] == '$') {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        bool equality_keys(nlohmann::json const& spec, std::vector<nlohmann::json>& keys)
+        {
+            if(!is_routable_value(spec)) {
+                return false;
+            } else if(!spec.is_object() || !is_operator_object(spec)) {
+                keys.push_back(spec);
+                return true;
+            } else if(spec.size() == 1 && spec.find("$eq") != spec.end()) {
+                return equality_keys(spec["$eq"], keys);
+            } else if(spec.size() == 1 && spec.find("$in") != spec.end() && spec["$in"].is_array()) {
+                for(auto const& value: spec["$in"]) {
+                    if(!is_routable_value(value)) {
+                        return false;
+                    }
+                    keys.push_back(value);
+                }
+                return true;
+            }
+            return false;
+        }
+
+        bool is_range_bound(nlohmann::json const& value)
+        {
+            return value.is_number() || value.is_string();
+        }
+    }
+
+    void live_query_router::add(observer* query, nlohmann::json::object_t const& selector)
+    {
+        auto const id = _next_route++;
+        auto r = std::make_shared<route>(route{ query, true, std::string(), {}, nullptr, nullptr, true, true });
+
+        for(auto const& field: selector) {
+            if(!field.first.empty() && field.first[0] != '$' && equality_keys(field.second, r->keys)) {
+                r->field = field.first;
+                break;
+            }
+            r->keys.clear();
+        }
+
+        if(r->field.empty()) {
+            for(auto const& field: selector) {
+                auto const& spec = field.second;
+                if(field.first.empty() || field.first[0] == '$' || !spec.is_object() || spec.empty()) {
+                    continue;
+                }
+
+                nlohmann::json lower, upper;
+                bool lower_inclusive = true, upper_inclusive = true, ranged = true;
+                for(auto it = spec.begin(); ranged && it != spec.end(); ++it) {
+                    if(it.key() == "$bt" && it->is_array() && it->size() == 2 && is_range_bound((*it)[0]) && is_range_bound((*it)[1])) {
+                        lower = (*it)[0];
+                        upper = (*it)[1];
+                    } else if((it.key() == "$gt" || it.key() == "$gte") && is_range_bound(*it)) {
+                        lower = *it;
+                        lower_inclusive = it.key() == "$gte";
+                    } else if((it.key() == "$lt" || it.key() == "$lte") && is_range_bound(*it)) {
+                        upper = *it;
+                        upper_inclusive = it.key() == "$lte";
+                    } else {
+                        ranged = false;
+                    }
+                }
+                if(ranged) {
+                    r->field = field.first;
+                    r->lower = lower;
+                    r->upper = upper;
+                    r->lower_inclusive = lower_inclusive;
+                    r->upper_inclusive = upper_inclusive;
+                    break;
+                }
+            }
+        }
+
+        if(!r->keys.empty()) {
+            auto& index = _equalities[r->field];
+            for(auto const& key: r->keys) {
+                index[key].insert(id);
+            }
+        } else if(!r->field.empty()) {
+            nlohmann::json const* key;
+            range_routes(_ranges[r->field], *r, key).emplace(*key, id);
+        } else {
+            _broadcast.insert(id);
+        }
+        _routes.emplace(id, r);
+        _query_routes.emplace(query, id);
+    }
+
+    void live_query_router::remove(observer* query)
+    {
+        auto const query_route = _query_routes.find(query);
+        if(query_route == _query_routes.end()) {
+            return;
+        }
+
+        auto const id = query_route->second;
+        auto const r = _routes.at(id);
+        r->active = false;
+        if(!r->keys.empty()) {
+            auto& index = _equalities[r->field];
+            for(auto const& key: r->keys) {
+                auto const it = index.find(key);
+                if(it != index.end() && it->second.erase(id) > 0 && it->second.empty()) {
+                    index.erase(it);
+                }
+            }
+            if(index.empty()) {
+                _equalities.erase(r->field);
+            }
+        } else if(!r->field.empty()) {
+            auto& index = _ranges[r->field];
+            nlohmann::json const* key;
+            auto& routes = range_routes(index, *r, key);
+            auto const range = routes.equal_range(*key);
+            for(auto it = range.first; it != range.second; ++it) {
+                if(it->second == id) {
+                    routes.erase(it);
+                    break;
+                }
+            }
+            if(index.empty()) {
+                _ranges.erase(r->field);
+            }
+        } else {
+            _broadcast.erase(id);
+        }
+        _routes.erase(id);
+        _query_routes.erase(query_route);
+    }
+
+    void live_query_router::document_added(std::string const& id, nlohmann::json::object_t const& fields)
+    {
+        auto document = fields;
+        document["_id"] = id;
+
+        std::set<std::uint64_t> routes;
+        collect(document, routes);
+        if(_batching) {
+            record(change{ change::kind::added, id, nullptr, std::make_shared<nlohmann::json::object_t const>(std::move(document)) }, routes);
+            return;
+        }
+        for(auto const& r: resolve(routes)) {
+            if(r->active) {
+                r->query->document_added(id, fields);
+            }
+        }
+    }
+
+    void live_query_router::document_changed(std::string const& id, nlohmann::json::object_t const& before, nlohmann::json::object_t const& after)
+    {
+        std::set<std::uint64_t> routes;
+        collect(before, routes);
+        collect(after, routes);
+        if(_batching) {
+            record(change{ change::kind::changed, id, std::make_shared<nlohmann::json::object_t const>(before), std::make_shared<nlohmann::json::object_t const>(after) }, routes);
+            return;
+        }
+        for(auto const& r: resolve(routes)) {
+            if(r->active) {
+                r->query->document_changed(id, before, after);
+            }
+        }
+    }
+
+    void live_query_router::document_removed(std::string const& id, nlohmann::json::object_t const& document)
+    {
+        std::set<std::uint64_t> routes;
+        collect(document, routes);
+        if(_batching) {
+            record(change{ change::kind::removed, id, std::make_shared<nlohmann::json::object_t const>(document), nullptr }, routes);
+            return;
+        }
+        for(auto const& r: resolve(routes)) {
+            if(r->active) {
+                r->query->document_removed(id, document);
+            }
+        }
+    }
+
+    void live_query_router::begin_batch()
+    {
+        _batching = true;
+    }
+
+    void live_query_router::commit_batch()
+    {
+        _batching = false;
+        std::vector<change> batch;
+        std::map<std::uint64_t, std::vector<std::size_t>> batch_routes;
+        batch.swap(_batch);
+        batch_routes.swap(_batch_routes);
+
+        std::vector<change const*> changes;
+        for(auto const& pending: batch_routes) {
+            auto const it = _routes.find(pending.first);
+            if(it == _routes.end()) {
+                continue;
+            }
+            auto const r = it->second;
+            changes.clear();
+            for(auto const index: pending.second) {
+                changes.push_back(&batch[index]);
+            }
+            r->query->apply_batch(changes);
+        }
+    }
+
+    void live_query_router::record(change&& c, std::set<std::uint64_t> const& routes)
+    {
+        auto const index = _batch.size();
+        _batch.push_back(std::move(c));
+        for(auto const id: routes) {
+            _batch_routes[id].push_back(index);
+        }
+    }
+
+    void live_query_router::collect(nlohmann::json::object_t const& document, std::set<std::uint64_t>& routes) const
+    {
+        routes.insert(_broadcast.begin(), _broadcast.end());
+
+        std::vector<nlohmann::json const*> values;
+        for(auto const& field: _equalities) {
+            values.clear();
+            field_path(field.first).resolve(document, values);
+            for(auto const* value: values) {
+                auto const it = field.second.find(*value);
+                if(it != field.second.end()) {
+                    routes.insert(it->second.begin(), it->second.end());
+                }
+                if(value->is_array()) {
+                    for(auto const& element: *value) {
+                        auto const it = field.second.find(element);
+                        if(it != field.second.end()) {
+                            routes.insert(it->second.begin(), it->second.end());
+                        }
+                    }
+                }
+            }
+        }
+
+        for(auto const& field: _ranges) {
+            values.clear();
+            field_path(field.first).resolve(document, values);
+            for(auto const* value: values) {
+                std::vector<nlohmann::json const*> candidates = { value };
+                if(value->is_array()) {
+                    for(auto const& element: *value) {
+                        candidates.push_back(&element);
+                    }
+                }
+                for(auto const* candidate: candidates) {
+                    auto const& index = field.second;
+                    for(auto it = index.lower_bounded.begin(), end = index.lower_bounded.upper_bound(*candidate); it != end; ++it) {
+                        if(in_range(*_routes.at(it->second), *candidate)) {
+                            routes.insert(it->second);
+                        }
+                    }
+                    for(auto it = index.upper_bounded.lower_bound(*candidate); it != index.upper_bounded.end(); ++it) {
+                        if(in_range(*_routes.at(it->second), *candidate)) {
+                            routes.insert(it->second);
+                        }
+                    }
+                    for(auto it = index.bounded.begin(), end = index.bounded.upper_bound(*candidate); it != end; ++it) {
+                        if(in_range(*_routes.at(it->second), *candidate)) {
+                            routes.insert(it->second);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    std::vector<std::shared_ptr<live_query_router::route>> live_query_router::resolve(std::set<std::uint64_t> const& routes) const
+    {
+        std::vector<std::shared_ptr<route>> resolved;
+        resolved.reserve(routes.size());
+        for(auto const id: routes) {
+            resolved.push_back(_routes.at(id));
+        }
+        return resolved;
+    }
+
+    bool live_query_router::range_index::empty() const
+    {
+        return lower_bounded.empty() && upper_bounded.empty() && bounded.empty();
+    }
+
+    std::multimap<nlohmann::json, std::uint64_t>& live_query_router::range_routes(range_index& index, route const& r, nlohmann::json const*& key)
+    {
+        if(r.lower.is_null()) {
+            key = &r.upper;
+            return index.upper_bounded;
+        }
+        key = &r.lower;
+        return r.upper.is_null() ? index.lower_bounded : index.bounded;
+    }
+
+    bool live_query_router::in_range(route const& r, nlohmann::json const& value)
+    {
+        if(!r.lower.is_null() && (r.lower_inclusive ? value < r.lower : !(r.lower < value))) {
+            return false;
+        }
+        if(!r.upper.is_null() && (r.upper_inclusive ? r.upper < value : !(value < r.upper))) {
+            return false;
+        }
+        return true;
+    }
+}
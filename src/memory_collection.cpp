@@ -0,0 +1,493 @@
+/*
+ * Copyright (c) 2015, Mario Flach. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <unordered_set>
+
+#include "../include/meteorpp/field_path.hpp"
+#include "../include/meteorpp/memory_collection.hpp"
+#include "../include/meteorpp/modifier.hpp"
+#include "../include/meteorpp/selector.hpp"
+#include "../include/meteorpp/sort_order.hpp"
+
+namespace meteorpp {
+    namespace {
+        selector compile_selector(nlohmann::json::object_t const& spec) throw(std::runtime_error)
+        {
+            try {
+                return selector(spec);
+            } catch(std::invalid_argument const& e) {
+                throw std::runtime_error(e.what());
+            }
+        }
+
+        modifier compile_modifier(nlohmann::json::object_t const& spec) throw(std::runtime_error)
+        {
+            try {
+                return modifier(spec);
+            } catch(std::invalid_argument const& e) {
+                throw std::runtime_error(e.what());
+            }
+        }
+
+        std::vector<nlohmann::json> index_keys(std::string const& path, nlohmann::json::object_t const& document)
+        {
+            std::vector<nlohmann::json const*> values;
+            field_path(path).resolve(document, values);
+
+            std::vector<nlohmann::json> keys;
+            for(auto const* value: values) {
+                keys.push_back(*value);
+                if(value->is_array()) {
+                    keys.insert(keys.end(), value->begin(), value->end());
+                }
+            }
+            return keys;
+        }
+
+        bool lookup_keys(nlohmann::json const& spec, std::vector<nlohmann::json>& keys)
+        {
+            if(spec.is_null()) {
+                return false;
+            } else if(!spec.is_object()) {
+                keys.push_back(spec);
+                return true;
+            } else if(spec.size() == 1 && spec.find("$eq") != spec.end()) {
+                return lookup_keys(spec["$eq"], keys);
+            } else if(spec.size() == 1 && spec.find("$in") != spec.end() && spec["$in"].is_array()) {
+                for(auto const& value: spec["$in"]) {
+                    if(value.is_null() || value.is_object()) {
+                        return false;
+                    }
+                    keys.push_back(value);
+                }
+                return true;
+            }
+            for(auto it = spec.begin(); it != spec.end(); ++it) {
+                if(!it.key().empty() && it.key()[0] == '$') {
+                    return false;
+                }
+            }
+            keys.push_back(spec);
+            return true;
+        }
+
+        bool is_truthy(nlohmann::json const& value)
+        {
+            return value.is_boolean() ? value.get<bool>() : (value.is_number() ? value.get<double>() != 0 : true);
+        }
+
+        nlohmann::json::object_t project(nlohmann::json::object_t const& document, nlohmann::json::object_t const& fields)
+        {
+            bool const include = std::any_of(fields.begin(), fields.end(), [](nlohmann::json::object_t::value_type const& field) {
+                return is_truthy(field.second);
+            });
+
+            nlohmann::json::object_t projected;
+            if(include) {
+                auto const id = document.find("_id");
+                auto const id_field = fields.find("_id");
+                if(id != document.end() && (id_field == fields.end() || is_truthy(id_field->second))) {
+                    projected.insert(*id);
+                }
+                for(auto const& field: fields) {
+                    field_path const path(field.first);
+                    auto const* value = path.find(document);
+                    if(value && is_truthy(field.second)) {
+                        *path.find(projected, true) = *value;
+                    }
+                }
+            } else {
+                projected = document;
+                for(auto const& field: fields) {
+                    if(field.first != "_id" && !is_truthy(field.second)) {
+                        field_path(field.first).erase(projected);
+                    }
+                }
+            }
+            return projected;
+        }
+    }
+
+    memory_collection::memory_collection(std::string const& name) throw(std::runtime_error)
+        : _name(name)
+    {
+        if(name.empty()) {
+            throw std::runtime_error("invalid collection name");
+        }
+    }
+
+    memory_collection::~memory_collection()
+    {
+    }
+
+    std::string const& memory_collection::name() const
+    {
+        return _name;
+    }
+
+    int memory_collection::count(nlohmann::json::object_t const& selector) throw(std::runtime_error)
+    {
+        return selector.empty() ? _documents.size() : select(selector).size();
+    }
+
+    std::vector<nlohmann::json::object_t> memory_collection::find(nlohmann::json::object_t const& selector, find_options const& options) throw(std::runtime_error)
+    {
+        auto matched = select(selector, options.sort.empty() && options.limit > 0 ? options.skip + options.limit : 0);
+        if(!options.sort.empty()) {
+            sort_order const order(options.sort);
+            std::stable_sort(matched.begin(), matched.end(), [&](nlohmann::json::object_t const* a, nlohmann::json::object_t const* b) {
+                return order(*a, *b);
+            });
+        }
+
+        auto const begin = std::min(options.skip, matched.size());
+        auto const end = options.limit > 0 ? std::min(begin + options.limit, matched.size()) : matched.size();
+
+        std::vector<nlohmann::json::object_t> results;
+        results.reserve(end - begin);
+        for(auto i = begin; i < end; ++i) {
+            results.push_back(options.fields.empty() ? *matched[i] : project(*matched[i], options.fields));
+        }
+        return results;
+    }
+
+    nlohmann::json::object_t memory_collection::find_one(nlohmann::json::object_t const& selector, find_options const& options) throw(std::runtime_error)
+    {
+        find_options first = options;
+        first.limit = 1;
+        auto const results = find(selector, first);
+        return results.empty() ? nlohmann::json::object_t() : results.front();
+    }
+
+    std::string memory_collection::insert(nlohmann::json::object_t const& document) throw(std::runtime_error)
+    {
+        auto const id = store(document);
+
+        document_added(id, document);
+        return id;
+    }
+
+    int memory_collection::update(nlohmann::json::object_t const& selector, nlohmann::json::object_t const& modifier) throw(std::runtime_error)
+    {
+        changeset changes;
+        int const count = modify(selector, modifier, changes);
+
+        notify_changes(changes);
+        return count;
+    }
+
+    int memory_collection::upsert(nlohmann::json::object_t const& selector, nlohmann::json::object_t const& modifier) throw(std::runtime_error)
+    {
+        auto const count = memory_collection::update(selector, {{ "$set", modifier }});
+        if(count > 0) {
+            return count;
+        }
+        memory_collection::insert(modifier);
+        return 1;
+    }
+
+    int memory_collection::remove(nlohmann::json::object_t const& selector) throw(std::runtime_error)
+    {
+        changeset changes;
+        removal_log removals;
+        int const count = erase(selector, changes, removals);
+
+        notify_changes(changes);
+        return count;
+    }
+
+    std::vector<std::string> memory_collection::insert_many(std::vector<nlohmann::json::object_t> const& documents) throw(std::runtime_error)
+    {
+        std::vector<std::string> ids;
+        ids.reserve(documents.size());
+        try {
+            for(auto const& document: documents) {
+                ids.push_back(store(document));
+            }
+        } catch(...) {
+            for(auto const& id: ids) {
+                auto const it = _ids.find(id);
+                unindex_document(id, *it->second);
+                _documents.erase(it->second);
+                _ids.erase(it);
+            }
+            throw;
+        }
+
+        notify_batch([&]() {
+            for(std::size_t i = 0; i < ids.size(); ++i) {
+                document_added(ids[i], documents[i]);
+            }
+        });
+        return ids;
+    }
+
+    int memory_collection::update_many(std::vector<std::pair<nlohmann::json::object_t, nlohmann::json::object_t>> const& updates) throw(std::runtime_error)
+    {
+        int count = 0;
+        changeset changes;
+        try {
+            for(auto const& update: updates) {
+                count += modify(update.first, update.second, changes);
+            }
+        } catch(...) {
+            rollback(changes);
+            throw;
+        }
+
+        notify_batch([&]() { notify_changes(changes); });
+        return count;
+    }
+
+    int memory_collection::remove_many(std::vector<nlohmann::json::object_t> const& selectors) throw(std::runtime_error)
+    {
+        int count = 0;
+        changeset changes;
+        removal_log removals;
+        try {
+            for(auto const& selector: selectors) {
+                count += erase(selector, changes, removals);
+            }
+        } catch(...) {
+            rollback(changes, removals);
+            throw;
+        }
+
+        notify_batch([&]() { notify_changes(changes); });
+        return count;
+    }
+
+    void memory_collection::ensure_index(std::string const& path) throw(std::runtime_error)
+    {
+        if(path.empty()) {
+            throw std::runtime_error("invalid index path");
+        } else if(path == "_id" || _indexes.find(path) != _indexes.end()) {
+            return;
+        }
+
+        auto& index = _indexes[path];
+        for(auto const& document: _documents) {
+            auto const& id = document.at("_id").get_ref<std::string const&>();
+            for(auto& key: index_keys(path, document)) {
+                index.emplace(std::move(key), id);
+            }
+        }
+    }
+
+    void memory_collection::drop_index(std::string const& path)
+    {
+        _indexes.erase(path);
+    }
+
+    std::vector<std::string> memory_collection::indexes() const
+    {
+        std::vector<std::string> paths;
+        for(auto const& index: _indexes) {
+            paths.push_back(index.first);
+        }
+        return paths;
+    }
+
+    std::vector<nlohmann::json::object_t*> memory_collection::select(nlohmann::json::object_t const& selector, std::size_t limit) throw(std::runtime_error)
+    {
+        auto const compiled = compile_selector(selector);
+
+        std::vector<nlohmann::json::object_t*> results;
+        auto const accept = [&](nlohmann::json::object_t& document) -> bool {
+            if(compiled.match(document)) {
+                results.push_back(&document);
+            }
+            return limit == 0 || results.size() < limit;
+        };
+
+        std::vector<std::string> ids;
+        if(candidates(selector, ids)) {
+            std::unordered_set<std::string> seen;
+            for(auto const& id: ids) {
+                auto const it = _ids.find(id);
+                if(it != _ids.end() && seen.insert(id).second && !accept(*it->second)) {
+                    break;
+                }
+            }
+        } else {
+            for(auto& document: _documents) {
+                if(!accept(document)) {
+                    break;
+                }
+            }
+        }
+        return results;
+    }
+
+    bool memory_collection::candidates(nlohmann::json::object_t const& selector, std::vector<std::string>& ids) const
+    {
+        for(auto const& field: selector) {
+            std::vector<nlohmann::json> keys;
+            if(field.first == "_id") {
+                if(!lookup_keys(field.second, keys)) {
+                    continue;
+                }
+                for(auto const& key: keys) {
+                    if(key.is_string()) {
+                        ids.push_back(key);
+                    }
+                }
+                return true;
+            }
+
+            auto const index = _indexes.find(field.first);
+            if(index == _indexes.end() || !lookup_keys(field.second, keys)) {
+                continue;
+            }
+            for(auto const& key: keys) {
+                for(auto it = index->second.lower_bound(std::make_pair(key, std::string())); it != index->second.end() && it->first == key; ++it) {
+                    ids.push_back(it->second);
+                }
+            }
+            return true;
+        }
+        return false;
+    }
+
+    std::string memory_collection::store(nlohmann::json::object_t document) throw(std::runtime_error)
+    {
+        auto const id_field = document.find("_id");
+        if(id_field == document.end()) {
+            document["_id"] = generate_id();
+        } else if(!id_field->second.is_string() || id_field->second.get_ref<std::string const&>().empty()) {
+            throw std::runtime_error("invalid document id");
+        }
+
+        std::string const id = document["_id"];
+        if(_ids.find(id) != _ids.end()) {
+            throw std::runtime_error("duplicate document id " + id);
+        }
+
+        index_document(id, document);
+        _ids.emplace(id, _documents.insert(_documents.end(), std::move(document)));
+        return id;
+    }
+
+    int memory_collection::modify(nlohmann::json::object_t const& selector, nlohmann::json::object_t const& modifier, changeset& changes) throw(std::runtime_error)
+    {
+        auto const compiled = compile_modifier(modifier);
+        auto const matched = select(selector);
+
+        changeset local;
+        try {
+            for(auto* document: matched) {
+                nlohmann::json::object_t after = *document;
+                compiled.apply(after);
+                if(after == *document) {
+                    continue;
+                }
+
+                std::string const id = document->at("_id");
+                local.changed.emplace(id, std::make_pair(*document, after));
+                unindex_document(id, *document);
+                *document = std::move(after);
+                index_document(id, *document);
+            }
+        } catch(std::exception const& e) {
+            rollback(local);
+            throw std::runtime_error(e.what());
+        }
+
+        changes.merge(std::move(local));
+        return matched.size();
+    }
+
+    int memory_collection::erase(nlohmann::json::object_t const& selector, changeset& changes, removal_log& removals) throw(std::runtime_error)
+    {
+        changeset local;
+        for(auto* document: select(selector)) {
+            std::string const id = document->at("_id");
+            auto const it = _ids.find(id);
+            auto const next = std::next(it->second);
+            removals.emplace_back(id, next != _documents.end() ? next->at("_id").get<std::string>() : std::string());
+            unindex_document(id, *document);
+            local.removed.emplace(id, std::move(*document));
+            _documents.erase(it->second);
+            _ids.erase(it);
+        }
+
+        int const count = local.removed.size();
+        changes.merge(std::move(local));
+        return count;
+    }
+
+    void memory_collection::rollback(changeset const& changes, removal_log const& removals)
+    {
+        for(auto const& change: changes.changed) {
+            auto const it = _ids.find(change.first);
+            if(it != _ids.end()) {
+                unindex_document(change.first, *it->second);
+                *it->second = change.second.first;
+                index_document(change.first, *it->second);
+            }
+        }
+        for(auto it = removals.rbegin(); it != removals.rend(); ++it) {
+            auto const removal = changes.removed.find(it->first);
+            if(removal == changes.removed.end() || _ids.find(it->first) != _ids.end()) {
+                continue;
+            }
+            auto const next = _ids.find(it->second);
+            index_document(it->first, removal->second);
+            _ids.emplace(it->first, _documents.insert(next != _ids.end() ? next->second : _documents.end(), removal->second));
+        }
+    }
+
+    void memory_collection::index_document(std::string const& id, nlohmann::json::object_t const& document)
+    {
+        for(auto& index: _indexes) {
+            for(auto& key: index_keys(index.first, document)) {
+                index.second.emplace(std::move(key), id);
+            }
+        }
+    }
+
+    void memory_collection::unindex_document(std::string const& id, nlohmann::json::object_t const& document)
+    {
+        for(auto& index: _indexes) {
+            for(auto& key: index_keys(index.first, document)) {
+                index.second.erase(std::make_pair(std::move(key), id));
+            }
+        }
+    }
+
+    std::string memory_collection::generate_id()
+    {
+        static std::random_device device;
+        static std::uint64_t const process = (std::uint64_t(device()) << 8 | (device() & 0xff)) & 0xffffffffffULL;
+        static std::uint32_t counter = device();
+
+        auto const seconds = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+
+        char buffer[25];
+        std::snprintf(buffer, sizeof(buffer), "%08x%010llx%06x", static_cast<unsigned>(seconds), static_cast<unsigned long long>(process), static_cast<unsigned>(++counter & 0xffffff));
+        return buffer;
+    }
+}
@@ -0,0 +1,212 @@
+/*
+ * Copyright (c) 2015, Mario Flach. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include <set>
+
+#include "../include/meteorpp/field_path.hpp"
+#include "../include/meteorpp/modifier.hpp"
+#include "../include/meteorpp/selector.hpp"
+
+namespace meteorpp {
+    namespace {
+        std::set<std::string> const supported_operators = {
+            "$set", "$unset", "$inc", "$mul", "$min", "$max", "$rename",
+            "$push", "$pushAll", "$addToSet", "$addToSetAll", "$pop", "$pull", "$pullAll"
+        };
+
+        bool is_id_path(std::string const& path)
+        {
+            return path.compare(0, 3, "_id") == 0 && (path.size() == 3 || path[3] == '.');
+        }
+
+        nlohmann::json& require_array(std::string const& op, nlohmann::json& value) throw(std::invalid_argument)
+        {
+            if(value.is_null()) {
+                value = nlohmann::json::array();
+            } else if(!value.is_array()) {
+                throw std::invalid_argument("couldn't apply " + op + " modifier to a non-array field");
+            }
+            return value;
+        }
+
+        nlohmann::json const& require_array_arg(std::string const& op, nlohmann::json const& arg) throw(std::invalid_argument)
+        {
+            if(!arg.is_array()) {
+                throw std::invalid_argument("couldn't apply " + op + " modifier, expected an array");
+            }
+            return arg;
+        }
+
+        std::function<bool(nlohmann::json const& element)> pull_predicate(nlohmann::json const& arg)
+        {
+            if(arg.is_object()) {
+                bool const with_operators = !arg.empty() && arg.begin().key()[0] == '$';
+                auto const match = with_operators ? selector({{ "element", arg }}) : selector(arg.get<nlohmann::json::object_t>());
+                return [match, with_operators](nlohmann::json const& element) {
+                    if(with_operators) {
+                        return match({{ "element", element }});
+                    }
+                    return element.is_object() && match(element.get_ref<nlohmann::json::object_t const&>());
+                };
+            }
+            return [arg](nlohmann::json const& element) {
+                return element == arg;
+            };
+        }
+    }
+
+    modifier::modifier(nlohmann::json::object_t const& modifier) throw(std::invalid_argument)
+        : _modifier(modifier), _replacement(true)
+    {
+        std::size_t operators = 0;
+        for(auto const& field: _modifier) {
+            if(!field.first.empty() && field.first[0] == '$') {
+                if(supported_operators.find(field.first) == supported_operators.end()) {
+                    throw std::invalid_argument("couldn't compile modifier, unsupported operator " + field.first);
+                } else if(!field.second.is_object()) {
+                    throw std::invalid_argument("couldn't compile modifier, " + field.first + " expects an object");
+                }
+                ++operators;
+            }
+        }
+        if(operators > 0 && operators < _modifier.size()) {
+            throw std::invalid_argument("couldn't compile modifier, operators mixed with fields");
+        }
+        _replacement = operators == 0;
+    }
+
+    void modifier::apply(nlohmann::json::object_t& document) const throw(std::invalid_argument)
+    {
+        if(_replacement) {
+            auto const id = document.find("_id");
+            nlohmann::json::object_t replacement = _modifier;
+            if(id != document.end()) {
+                replacement["_id"] = id->second;
+            }
+            document.swap(replacement);
+            return;
+        }
+
+        try {
+            for(auto const& op: _modifier) {
+                for(auto it = op.second.begin(); it != op.second.end(); ++it) {
+                    if(is_id_path(it.key())) {
+                        throw std::invalid_argument("couldn't apply " + op.first + " modifier, _id is immutable");
+                    }
+                    apply(op.first, it.key(), it.value(), document);
+                }
+            }
+        } catch(std::invalid_argument const&) {
+            throw;
+        } catch(std::exception const& e) {
+            throw std::invalid_argument("couldn't apply modifier, " + std::string(e.what()));
+        }
+    }
+
+    void modifier::apply(std::string const& op, std::string const& path, nlohmann::json const& arg, nlohmann::json::object_t& document) const throw(std::invalid_argument)
+    {
+        field_path const field(path);
+        if(op == "$set") {
+            *field.find(document, true) = arg;
+        } else if(op == "$unset") {
+            field.erase(document);
+        } else if(op == "$inc" || op == "$mul") {
+            if(!arg.is_number()) {
+                throw std::invalid_argument("couldn't apply " + op + " modifier, expected a number");
+            }
+            auto& value = *field.find(document, true);
+            if(value.is_null()) {
+                value = op == "$inc" ? arg : nlohmann::json(0);
+            } else if(!value.is_number()) {
+                throw std::invalid_argument("couldn't apply " + op + " modifier to a non-numeric field");
+            } else if(value.is_number_float() || arg.is_number_float()) {
+                value = op == "$inc" ? value.get<double>() + arg.get<double>() : value.get<double>() * arg.get<double>();
+            } else {
+                value = op == "$inc" ? value.get<std::int64_t>() + arg.get<std::int64_t>() : value.get<std::int64_t>() * arg.get<std::int64_t>();
+            }
+        } else if(op == "$min" || op == "$max") {
+            auto& value = *field.find(document, true);
+            if(value.is_null() || (op == "$min" ? arg < value : value < arg)) {
+                value = arg;
+            }
+        } else if(op == "$rename") {
+            if(!arg.is_string()) {
+                throw std::invalid_argument("couldn't apply $rename modifier, expected a field name");
+            } else if(is_id_path(arg.get_ref<std::string const&>())) {
+                throw std::invalid_argument("couldn't apply $rename modifier, _id is immutable");
+            }
+            auto const* value = field.find(document);
+            if(value) {
+                auto const renamed = *value;
+                field.erase(document);
+                *field_path(arg.get<std::string>()).find(document, true) = renamed;
+            }
+        } else if(op == "$push" || op == "$pushAll" || op == "$addToSet" || op == "$addToSetAll") {
+            auto& value = require_array(op, *field.find(document, true));
+            nlohmann::json elements;
+            if(op == "$pushAll" || op == "$addToSetAll") {
+                elements = require_array_arg(op, arg);
+            } else if(arg.is_object() && arg.find("$each") != arg.end()) {
+                elements = require_array_arg(op, arg["$each"]);
+            } else {
+                elements = nlohmann::json::array({ arg });
+            }
+            bool const unique = op == "$addToSet" || op == "$addToSetAll";
+            for(auto const& element: elements) {
+                if(!unique || std::find(value.begin(), value.end(), element) == value.end()) {
+                    value.push_back(element);
+                }
+            }
+        } else if(op == "$pop") {
+            auto* value = field.find(document);
+            if(value && !require_array(op, *value).empty()) {
+                if(arg.is_number() && arg < 0) {
+                    value->erase(value->begin());
+                } else {
+                    value->erase(value->size() - 1);
+                }
+            }
+        } else if(op == "$pull" || op == "$pullAll") {
+            auto* value = field.find(document);
+            if(value) {
+                auto& elements = require_array(op, *value);
+                std::function<bool(nlohmann::json const& element)> predicate;
+                if(op == "$pullAll") {
+                    auto const& pulled = require_array_arg(op, arg);
+                    predicate = [&pulled](nlohmann::json const& element) {
+                        return std::find(pulled.begin(), pulled.end(), element) != pulled.end();
+                    };
+                } else {
+                    predicate = pull_predicate(arg);
+                }
+                nlohmann::json kept = nlohmann::json::array();
+                for(auto const& element: elements) {
+                    if(!predicate(element)) {
+                        kept.push_back(element);
+                    }
+                }
+                elements.swap(kept);
+            }
+        }
+    }
+}
@@ -0,0 +1,288 @@
+/*
+ * Copyright (c) 2015, Mario Flach. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include <algorithm>
+#include <functional>
+#include <random>
+
+#include "../include/meteorpp/persistent_sequence.hpp"
+
+namespace meteorpp {
+    struct persistent_sequence::node
+    {
+        value_type value;
+        node_ptr left;
+        node_ptr right;
+        std::size_t size;
+        std::uint64_t priority;
+    };
+
+    namespace {
+        template<typename node_ptr>
+        std::size_t size_of(node_ptr const& n)
+        {
+            return n ? n->size : 0;
+        }
+
+        std::uint32_t random_bits()
+        {
+            static thread_local std::minstd_rand generator(std::random_device{}());
+            return static_cast<std::uint32_t>(generator());
+        }
+
+        /* Priorities put the height of a node above random bits, so that the balanced trees built from whole
+         * sequences are valid heaps. Inserted nodes draw a height with P(height >= k) = 2^-k, the share of nodes
+         * which are that high in a balanced tree.
+         */
+        std::uint64_t priority(std::uint32_t height)
+        {
+            return static_cast<std::uint64_t>(height) << 32 | random_bits();
+        }
+
+        std::uint32_t random_height()
+        {
+            std::uint32_t height = 0;
+            for(auto bits = random_bits(); (bits & 1) != 0 && height < 31; bits >>= 1) {
+                ++height;
+            }
+            return height;
+        }
+    }
+
+    persistent_sequence::iterator::iterator()
+    {
+    }
+
+    persistent_sequence::iterator::iterator(node const* root)
+    {
+        descend(root);
+    }
+
+    persistent_sequence::value_type const& persistent_sequence::iterator::operator*() const
+    {
+        return _path.back()->value;
+    }
+
+    persistent_sequence::value_type const* persistent_sequence::iterator::operator->() const
+    {
+        return &_path.back()->value;
+    }
+
+    persistent_sequence::iterator& persistent_sequence::iterator::operator++()
+    {
+        auto const* current = _path.back();
+        _path.pop_back();
+        descend(current->right.get());
+        return *this;
+    }
+
+    persistent_sequence::iterator persistent_sequence::iterator::operator++(int)
+    {
+        auto const it = *this;
+        ++*this;
+        return it;
+    }
+
+    bool persistent_sequence::iterator::operator==(iterator const& other) const
+    {
+        return _path.empty() ? other._path.empty() : !other._path.empty() && _path.back() == other._path.back();
+    }
+
+    bool persistent_sequence::iterator::operator!=(iterator const& other) const
+    {
+        return !(*this == other);
+    }
+
+    void persistent_sequence::iterator::descend(node const* n)
+    {
+        for(; n; n = n->left.get()) {
+            _path.push_back(n);
+        }
+    }
+
+    persistent_sequence::persistent_sequence()
+    {
+    }
+
+    persistent_sequence::persistent_sequence(std::vector<value_type> const& elements)
+    {
+        std::function<node_ptr(std::size_t, std::size_t, std::uint32_t&)> build = [&](std::size_t first, std::size_t last, std::uint32_t& height) -> node_ptr {
+            if(first == last) {
+                height = 0;
+                return nullptr;
+            }
+            auto const middle = first + (last - first) / 2;
+            std::uint32_t left_height, right_height;
+            auto left = build(first, middle, left_height);
+            auto right = build(middle + 1, last, right_height);
+            height = std::max(left_height, right_height) + 1;
+            return std::make_shared<node const>(node{ elements[middle], std::move(left), std::move(right), last - first, priority(height) });
+        };
+        std::uint32_t height;
+        _root = build(0, elements.size(), height);
+    }
+
+    persistent_sequence::persistent_sequence(node_ptr const& root)
+        : _root(root)
+    {
+    }
+
+    std::size_t persistent_sequence::size() const
+    {
+        return size_of(_root);
+    }
+
+    bool persistent_sequence::empty() const
+    {
+        return !_root;
+    }
+
+    persistent_sequence::value_type const& persistent_sequence::at(std::size_t index) const throw(std::out_of_range)
+    {
+        if(index >= size()) {
+            throw std::out_of_range("persistent_sequence index out of range");
+        }
+        auto const* n = _root.get();
+        for(;;) {
+            auto const left = size_of(n->left);
+            if(index < left) {
+                n = n->left.get();
+            } else if(index > left) {
+                index -= left + 1;
+                n = n->right.get();
+            } else {
+                return n->value;
+            }
+        }
+    }
+
+    persistent_sequence::value_type const& persistent_sequence::front() const throw(std::out_of_range)
+    {
+        return at(0);
+    }
+
+    persistent_sequence::value_type const& persistent_sequence::back() const throw(std::out_of_range)
+    {
+        return at(size() - 1);
+    }
+
+    persistent_sequence::iterator persistent_sequence::begin() const
+    {
+        return iterator(_root.get());
+    }
+
+    persistent_sequence::iterator persistent_sequence::end() const
+    {
+        return iterator();
+    }
+
+    persistent_sequence persistent_sequence::insert(std::size_t index, value_type const& value) const throw(std::out_of_range)
+    {
+        if(index > size()) {
+            throw std::out_of_range("persistent_sequence index out of range");
+        }
+        return persistent_sequence(insert_node(_root, index, value, priority(random_height())));
+    }
+
+    persistent_sequence persistent_sequence::erase(std::size_t index) const throw(std::out_of_range)
+    {
+        if(index >= size()) {
+            throw std::out_of_range("persistent_sequence index out of range");
+        }
+        return persistent_sequence(erase_node(_root, index));
+    }
+
+    persistent_sequence persistent_sequence::replace(std::size_t index, value_type const& value) const throw(std::out_of_range)
+    {
+        if(index >= size()) {
+            throw std::out_of_range("persistent_sequence index out of range");
+        }
+        return persistent_sequence(replace_node(_root, index, value));
+    }
+
+    persistent_sequence::node_ptr persistent_sequence::join(value_type const& value, node_ptr const& left, node_ptr const& right, std::uint64_t priority)
+    {
+        return std::make_shared<node const>(node{ value, left, right, size_of(left) + size_of(right) + 1, priority });
+    }
+
+    std::pair<persistent_sequence::node_ptr, persistent_sequence::node_ptr> persistent_sequence::split(node_ptr const& n, std::size_t index)
+    {
+        if(!n) {
+            return std::make_pair(nullptr, nullptr);
+        }
+        auto const left = size_of(n->left);
+        if(index <= left) {
+            auto const parts = split(n->left, index);
+            return std::make_pair(parts.first, join(n->value, parts.second, n->right, n->priority));
+        }
+        auto const parts = split(n->right, index - left - 1);
+        return std::make_pair(join(n->value, n->left, parts.first, n->priority), parts.second);
+    }
+
+    persistent_sequence::node_ptr persistent_sequence::merge(node_ptr const& left, node_ptr const& right)
+    {
+        if(!left) {
+            return right;
+        } else if(!right) {
+            return left;
+        } else if(left->priority > right->priority) {
+            return join(left->value, left->left, merge(left->right, right), left->priority);
+        }
+        return join(right->value, merge(left, right->left), right->right, right->priority);
+    }
+
+    persistent_sequence::node_ptr persistent_sequence::insert_node(node_ptr const& n, std::size_t index, value_type const& value, std::uint64_t priority)
+    {
+        if(!n || priority > n->priority) {
+            auto const parts = split(n, index);
+            return join(value, parts.first, parts.second, priority);
+        }
+        auto const left = size_of(n->left);
+        if(index <= left) {
+            return join(n->value, insert_node(n->left, index, value, priority), n->right, n->priority);
+        }
+        return join(n->value, n->left, insert_node(n->right, index - left - 1, value, priority), n->priority);
+    }
+
+    persistent_sequence::node_ptr persistent_sequence::erase_node(node_ptr const& n, std::size_t index)
+    {
+        auto const left = size_of(n->left);
+        if(index < left) {
+            return join(n->value, erase_node(n->left, index), n->right, n->priority);
+        } else if(index > left) {
+            return join(n->value, n->left, erase_node(n->right, index - left - 1), n->priority);
+        }
+        return merge(n->left, n->right);
+    }
+
+    persistent_sequence::node_ptr persistent_sequence::replace_node(node_ptr const& n, std::size_t index, value_type const& value)
+    {
+        auto const left = size_of(n->left);
+        if(index < left) {
+            return join(n->value, replace_node(n->left, index, value), n->right, n->priority);
+        } else if(index > left) {
+            return join(n->value, n->left, replace_node(n->right, index - left - 1, value), n->priority);
+        }
+        return join(value, n->left, n->right, n->priority);
+    }
+}
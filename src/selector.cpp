@@ -0,0 +1,350 @@
+/*
+ * Copyright (c) 2015, Mario Flach. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include <regex>
+
+#include "../include/meteorpp/field_path.hpp"
+#include "../include/meteorpp/selector.hpp"
+
+namespace meteorpp {
+    namespace {
+        typedef std::vector<nlohmann::json const*> values_t;
+        typedef std::function<bool(values_t const& values)> values_predicate;
+        typedef std::function<bool(nlohmann::json const& value)> value_predicate;
+
+        selector::predicate compile_selector(nlohmann::json::object_t const& selector);
+
+        values_predicate compile_operators(nlohmann::json const& spec);
+
+        bool any_value(values_t const& values, value_predicate const& predicate)
+        {
+            for(auto const* value: values) {
+                if(predicate(*value)) {
+                    return true;
+                }
+                if(value->is_array()) {
+                    for(auto const& element: *value) {
+                        if(predicate(element)) {
+                            return true;
+                        }
+                    }
+                }
+            }
+            return false;
+        }
+
+        bool comparable(nlohmann::json const& a, nlohmann::json const& b)
+        {
+            return (a.is_number() && b.is_number()) || (a.is_string() && b.is_string()) || (a.is_boolean() && b.is_boolean());
+        }
+
+        bool truthy(nlohmann::json const& value)
+        {
+            return value.is_boolean() ? value.get<bool>() : value.is_number() ? value != 0 : !value.is_null();
+        }
+
+        std::string to_lower(std::string value)
+        {
+            std::transform(value.begin(), value.end(), value.begin(), ::tolower);
+            return value;
+        }
+
+        bool is_operator_object(nlohmann::json const& value) throw(std::invalid_argument)
+        {
+            if(!value.is_object() || value.empty()) {
+                return false;
+            }
+
+            std::size_t operators = 0;
+            for(auto it = value.begin(); it != value.end(); ++it) {
+                if(!it.key().empty() && it.key()[0] == '$') {
+                    ++operators;
+                }
+            }
+            if(operators > 0 && operators < value.size()) {
+                throw std::invalid_argument("couldn't compile selector, operators mixed with fields");
+            }
+            return operators > 0;
+        }
+
+        nlohmann::json const& require_array(std::string const& op, nlohmann::json const& arg) throw(std::invalid_argument)
+        {
+            if(!arg.is_array()) {
+                throw std::invalid_argument("couldn't compile selector, " + op + " expects an array");
+            }
+            return arg;
+        }
+
+        std::string const& require_string(std::string const& op, nlohmann::json const& arg) throw(std::invalid_argument)
+        {
+            if(!arg.is_string()) {
+                throw std::invalid_argument("couldn't compile selector, " + op + " expects a string");
+            }
+            return arg.get_ref<std::string const&>();
+        }
+
+        values_predicate equals(nlohmann::json const& expected)
+        {
+            return [expected](values_t const& values) {
+                if(expected.is_null() && values.empty()) {
+                    return true;
+                }
+                return any_value(values, [&](nlohmann::json const& value) {
+                    return value == expected;
+                });
+            };
+        }
+
+        values_predicate in(nlohmann::json const& expected)
+        {
+            bool const with_null = std::find(expected.begin(), expected.end(), nullptr) != expected.end();
+            return [expected, with_null](values_t const& values) {
+                if(with_null && values.empty()) {
+                    return true;
+                }
+                return any_value(values, [&](nlohmann::json const& value) {
+                    return std::find(expected.begin(), expected.end(), value) != expected.end();
+                });
+            };
+        }
+
+        values_predicate negate(values_predicate const& predicate)
+        {
+            return [predicate](values_t const& values) {
+                return !predicate(values);
+            };
+        }
+
+        values_predicate any_of(value_predicate const& predicate)
+        {
+            return [predicate](values_t const& values) {
+                return any_value(values, predicate);
+            };
+        }
+
+        values_predicate compile_operator(std::string const& op, nlohmann::json const& arg, nlohmann::json const& spec) throw(std::invalid_argument)
+        {
+            if(op == "$eq") {
+                return equals(arg);
+            } else if(op == "$ne") {
+                return negate(equals(arg));
+            } else if(op == "$gt") {
+                return any_of([arg](nlohmann::json const& value) { return comparable(value, arg) && arg < value; });
+            } else if(op == "$gte") {
+                return any_of([arg](nlohmann::json const& value) { return comparable(value, arg) && !(value < arg); });
+            } else if(op == "$lt") {
+                return any_of([arg](nlohmann::json const& value) { return comparable(value, arg) && value < arg; });
+            } else if(op == "$lte") {
+                return any_of([arg](nlohmann::json const& value) { return comparable(value, arg) && !(arg < value); });
+            } else if(op == "$in") {
+                return in(require_array(op, arg));
+            } else if(op == "$nin") {
+                return negate(in(require_array(op, arg)));
+            } else if(op == "$bt") {
+                if(require_array(op, arg).size() != 2) {
+                    throw std::invalid_argument("couldn't compile selector, $bt expects two bounds");
+                }
+                return any_of([arg](nlohmann::json const& value) {
+                    return comparable(value, arg[0]) && comparable(value, arg[1]) && !(value < arg[0]) && !(arg[1] < value);
+                });
+            } else if(op == "$exists") {
+                bool const exists = truthy(arg);
+                return [exists](values_t const& values) {
+                    return values.empty() != exists;
+                };
+            } else if(op == "$not") {
+                if(!is_operator_object(arg)) {
+                    throw std::invalid_argument("couldn't compile selector, $not expects an operator object");
+                }
+                return negate(compile_operators(arg));
+            } else if(op == "$size") {
+                if(!arg.is_number_integer() || arg < 0) {
+                    throw std::invalid_argument("couldn't compile selector, $size expects a non-negative integer");
+                }
+                auto const size = arg.get<std::size_t>();
+                return [size](values_t const& values) {
+                    return std::any_of(values.begin(), values.end(), [size](nlohmann::json const* value) {
+                        return value->is_array() && value->size() == size;
+                    });
+                };
+            } else if(op == "$all") {
+                require_array(op, arg);
+                return [arg](values_t const& values) {
+                    return std::any_of(values.begin(), values.end(), [&arg](nlohmann::json const* value) {
+                        return value->is_array() && !arg.empty() && std::all_of(arg.begin(), arg.end(), [value](nlohmann::json const& expected) {
+                            return std::find(value->begin(), value->end(), expected) != value->end();
+                        });
+                    });
+                };
+            } else if(op == "$elemMatch") {
+                if(!arg.is_object()) {
+                    throw std::invalid_argument("couldn't compile selector, $elemMatch expects an object");
+                }
+                value_predicate element_predicate;
+                if(is_operator_object(arg)) {
+                    auto const predicate = compile_operators(arg);
+                    element_predicate = [predicate](nlohmann::json const& element) {
+                        return predicate({ &element });
+                    };
+                } else {
+                    auto const predicate = compile_selector(arg);
+                    element_predicate = [predicate](nlohmann::json const& element) {
+                        return element.is_object() && predicate(element.get_ref<nlohmann::json::object_t const&>());
+                    };
+                }
+                return [element_predicate](values_t const& values) {
+                    return std::any_of(values.begin(), values.end(), [&](nlohmann::json const* value) {
+                        return value->is_array() && std::any_of(value->begin(), value->end(), element_predicate);
+                    });
+                };
+            } else if(op == "$regex") {
+                auto flags = std::regex::ECMAScript;
+                auto const options = spec.find("$options");
+                if(options != spec.end() && require_string("$options", *options).find('i') != std::string::npos) {
+                    flags |= std::regex::icase;
+                }
+                std::regex pattern;
+                try {
+                    pattern.assign(require_string(op, arg), flags);
+                } catch(std::regex_error const& e) {
+                    throw std::invalid_argument("couldn't compile selector, invalid $regex: " + std::string(e.what()));
+                }
+                return any_of([pattern](nlohmann::json const& value) {
+                    return value.is_string() && std::regex_search(value.get_ref<std::string const&>(), pattern);
+                });
+            } else if(op == "$options") {
+                if(spec.find("$regex") == spec.end()) {
+                    throw std::invalid_argument("couldn't compile selector, $options without $regex");
+                }
+                return [](values_t const& values) {
+                    return true;
+                };
+            } else if(op == "$begin") {
+                auto const prefix = require_string(op, arg);
+                return any_of([prefix](nlohmann::json const& value) {
+                    return value.is_string() && value.get_ref<std::string const&>().compare(0, prefix.size(), prefix) == 0;
+                });
+            } else if(op == "$icase" && arg.is_string()) {
+                auto const expected = to_lower(arg.get<std::string>());
+                return any_of([expected](nlohmann::json const& value) {
+                    return value.is_string() && to_lower(value.get<std::string>()) == expected;
+                });
+            }
+            throw std::invalid_argument("couldn't compile selector, unsupported operator " + op);
+        }
+
+        values_predicate compile_operators(nlohmann::json const& spec)
+        {
+            std::vector<values_predicate> predicates;
+            for(auto it = spec.begin(); it != spec.end(); ++it) {
+                predicates.push_back(compile_operator(it.key(), it.value(), spec));
+            }
+            return [predicates](values_t const& values) {
+                return std::all_of(predicates.begin(), predicates.end(), [&values](values_predicate const& predicate) {
+                    return predicate(values);
+                });
+            };
+        }
+
+        selector::predicate compile_field(std::string const& path, nlohmann::json const& spec)
+        {
+            field_path const field(path);
+            auto const predicate = is_operator_object(spec) ? compile_operators(spec) : equals(spec);
+            return [field, predicate](nlohmann::json::object_t const& document) {
+                values_t values;
+                field.resolve(document, values);
+                return predicate(values);
+            };
+        }
+
+        std::vector<selector::predicate> compile_clauses(std::string const& op, nlohmann::json const& arg) throw(std::invalid_argument)
+        {
+            std::vector<selector::predicate> clauses;
+            for(auto const& clause: require_array(op, arg)) {
+                if(!clause.is_object()) {
+                    throw std::invalid_argument("couldn't compile selector, " + op + " expects an array of selectors");
+                }
+                clauses.push_back(compile_selector(clause.get_ref<nlohmann::json::object_t const&>()));
+            }
+            return clauses;
+        }
+
+        selector::predicate compile_selector(nlohmann::json::object_t const& selector)
+        {
+            std::vector<selector::predicate> clauses;
+            for(auto const& field: selector) {
+                if(field.first == "$and" || field.first == "$or" || field.first == "$nor") {
+                    auto const subclauses = compile_clauses(field.first, field.second);
+                    auto const match_clause = [](nlohmann::json::object_t const& document) {
+                        return [&document](selector::predicate const& clause) {
+                            return clause(document);
+                        };
+                    };
+                    if(field.first == "$and") {
+                        clauses.push_back([subclauses, match_clause](nlohmann::json::object_t const& document) {
+                            return std::all_of(subclauses.begin(), subclauses.end(), match_clause(document));
+                        });
+                    } else if(field.first == "$or") {
+                        clauses.push_back([subclauses, match_clause](nlohmann::json::object_t const& document) {
+                            return std::any_of(subclauses.begin(), subclauses.end(), match_clause(document));
+                        });
+                    } else {
+                        clauses.push_back([subclauses, match_clause](nlohmann::json::object_t const& document) {
+                            return std::none_of(subclauses.begin(), subclauses.end(), match_clause(document));
+                        });
+                    }
+                } else if(!field.first.empty() && field.first[0] == '$') {
+                    throw std::invalid_argument("couldn't compile selector, unsupported operator " + field.first);
+                } else {
+                    clauses.push_back(compile_field(field.first, field.second));
+                }
+            }
+            return [clauses](nlohmann::json::object_t const& document) {
+                return std::all_of(clauses.begin(), clauses.end(), [&document](selector::predicate const& clause) {
+                    return clause(document);
+                });
+            };
+        }
+    }
+
+    selector::selector(nlohmann::json::object_t const& selector) throw(std::invalid_argument)
+    {
+        try {
+            _predicate = compile_selector(selector);
+        } catch(std::invalid_argument const&) {
+            throw;
+        } catch(std::exception const& e) {
+            throw std::invalid_argument("couldn't compile selector, " + std::string(e.what()));
+        }
+    }
+
+    bool selector::match(nlohmann::json::object_t const& document) const
+    {
+        return _predicate(document);
+    }
+
+    bool selector::operator()(nlohmann::json::object_t const& document) const
+    {
+        return _predicate(document);
+    }
+}
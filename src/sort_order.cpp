@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2015, Mario Flach. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include "../include/meteorpp/sort_order.hpp"
+
+namespace meteorpp {
+    sort_order::sort_order(specification const& keys)
+    {
+        for(auto const& key: keys) {
+            _keys.emplace_back(field_path(key.first), !(key.second < 0));
+        }
+    }
+
+    bool sort_order::empty() const
+    {
+        return _keys.empty();
+    }
+
+    bool sort_order::operator()(nlohmann::json::object_t const& a, nlohmann::json::object_t const& b) const
+    {
+        static nlohmann::json const missing;
+        for(auto const& key: _keys) {
+            auto const* value_a = key.first.find(a);
+            auto const* value_b = key.first.find(b);
+            auto const& key_a = value_a ? *value_a : missing;
+            auto const& key_b = value_b ? *value_b : missing;
+            if(key_a != key_b) {
+                return key.second ? key_a < key_b : key_b < key_a;
+            }
+        }
+        return false;
+    }
+}
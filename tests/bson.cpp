@@ -0,0 +1,21 @@
+#include <meteorpp/bson.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_CASE(bson_round_trip_scalars)
+{
+    nlohmann::json const doc = {{ "null", nullptr }, { "bool", true }, { "int", 42 }, { "long", 1ll << 40 }, { "double", 0.5 }, { "string", "foo" }};
+    auto const value = meteorpp::json_to_bson(doc);
+    BOOST_CHECK_EQUAL(meteorpp::bson_to_json(bson_data(value.get())), doc);
+}
+
+BOOST_AUTO_TEST_CASE(bson_round_trip_nested)
+{
+    nlohmann::json const doc = {{ "foo", {{ "bar", { 1, "baz", {{ "qux", false }}, nlohmann::json::array() }} }}, { "empty", nlohmann::json::object() }};
+    auto const value = meteorpp::json_to_bson(doc);
+    BOOST_CHECK_EQUAL(meteorpp::bson_to_json(bson_data(value.get())), doc);
+}
+
+BOOST_AUTO_TEST_CASE(bson_invalid_root)
+{
+    BOOST_CHECK_THROW(meteorpp::json_to_bson("foo"), std::invalid_argument);
+}
@@ -1,6 +1,357 @@
 #include <meteorpp/ddp.hpp>
+#include <meteorpp/ddp_collection.hpp>
+#include <websocketpp/server.hpp>
 #include <boost/test/unit_test.hpp>
 
-BOOST_AUTO_TEST_CASE(test)
+#include <set>
+#include <thread>
+
+typedef websocketpp::server<websocketpp::config::asio> ddp_server;
+
+/* A DDP server on the loopback interface, answering connect messages and handing the others to the handler.
+ */
+struct ddp_fixture {
+    ddp_fixture() : client(std::make_shared<meteorpp::ddp>(io))
+    {
+        server.init_asio(&io);
+        server.set_reuse_addr(true);
+        server.clear_access_channels(websocketpp::log::alevel::all);
+        server.clear_error_channels(websocketpp::log::elevel::all);
+        server.set_open_handler([this](websocketpp::connection_hdl hdl) { connection = hdl; });
+        server.set_message_handler([this](websocketpp::connection_hdl hdl, ddp_server::message_ptr msg) {
+            auto const payload = nlohmann::json::parse(msg->get_payload());
+            received.push_back(payload);
+            if(payload["msg"] == "connect") {
+                sessions.push_back(payload.count("session") ? payload["session"].get<std::string>() : std::string());
+                reply({{ "msg", "connected" }, { "session", "session" + std::to_string(sessions.size()) }});
+            } else if(handler) {
+                handler(payload);
+            }
+        });
+        server.listen(websocketpp::lib::asio::ip::tcp::endpoint(websocketpp::lib::asio::ip::address::from_string("127.0.0.1"), 0));
+        server.start_accept();
+
+        websocketpp::lib::asio::error_code error_code;
+        url = "ws://127.0.0.1:" + std::to_string(server.get_local_endpoint(error_code).port()) + "/websocket";
+        client->set_reconnect_delay(boost::posix_time::milliseconds(10), boost::posix_time::milliseconds(10));
+    }
+
+    ~ddp_fixture()
+    {
+        server.stop_listening();
+        drop();
+        run_until([]() { return false; }, boost::posix_time::milliseconds(50));
+    }
+
+    void reply(nlohmann::json const& payload)
+    {
+        server.send(connection, payload.dump(), websocketpp::frame::opcode::text);
+    }
+
+    void drop()
+    {
+        websocketpp::lib::error_code error_code;
+        server.close(connection, websocketpp::close::status::going_away, "", error_code);
+    }
+
+    std::size_t count_received(std::string const& msg) const
+    {
+        return std::count_if(received.begin(), received.end(), [&](nlohmann::json const& payload) { return payload["msg"] == msg; });
+    }
+
+    bool run_until(std::function<bool()> const& done, boost::posix_time::time_duration const& timeout = boost::posix_time::seconds(5))
+    {
+        auto const deadline = boost::posix_time::microsec_clock::universal_time() + timeout;
+        while(!done()) {
+            if(boost::posix_time::microsec_clock::universal_time() > deadline) {
+                return false;
+            }
+            io.reset();
+            if(io.poll() == 0) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+        return true;
+    }
+
+    boost::asio::io_service io;
+    ddp_server server;
+    websocketpp::connection_hdl connection;
+    std::string url;
+    std::vector<nlohmann::json> received;
+    std::vector<std::string> sessions;
+    std::function<void(nlohmann::json const&)> handler;
+    std::shared_ptr<meteorpp::ddp> client;
+};
+
+BOOST_FIXTURE_TEST_CASE(ddp_decodes_message_types, ddp_fixture)
+{
+    std::vector<std::string> added;
+    client->on_document_added([&](std::string const& collection, std::string const& id, nlohmann::json::object_t const& fields) {
+        added.push_back(collection + '/' + id + '/' + nlohmann::json(fields).dump());
+    });
+
+    std::string session;
+    client->connect(url, [&](std::string const& id) {
+        session = id;
+        reply({{ "msg", "bogus" }});
+        reply({{ "id", "no type" }});
+        reply({{ "msg", 42 }});
+        reply({{ "msg", "ping" }, { "id", "p1" }});
+        reply({{ "msg", "added" }, { "collection", "items" }, { "id", "a" }, { "fields", {{ "n", 1 }} }});
+    });
+    BOOST_REQUIRE(run_until([&]() { return !added.empty() && count_received("pong") > 0; }));
+
+    BOOST_CHECK_EQUAL(session, "session1");
+    BOOST_CHECK_EQUAL(client->session(), "session1");
+    BOOST_CHECK_EQUAL(added.size(), 1);
+    BOOST_CHECK_EQUAL(added.front(), "items/a/{\"n\":1}");
+    BOOST_CHECK_EQUAL(received.back()["msg"], "pong");
+    BOOST_CHECK_EQUAL(received.back()["id"], "p1");
+}
+
+BOOST_FIXTURE_TEST_CASE(ddp_method_timeout, ddp_fixture)
+{
+    handler = [&](nlohmann::json const& payload) {
+        if(payload["msg"] == "method" && payload["method"] == "fast") {
+            reply({{ "msg", "result" }, { "id", payload["id"] }, { "result", 7 }});
+        }
+    };
+    client->connect(url);
+
+    nlohmann::json fast_result, slow_error;
+    int calls = 0;
+    client->call_method("fast", {}, [&](std::string const& id, nlohmann::json const& result, nlohmann::json const& error) {
+        fast_result = result;
+        ++calls;
+    }, boost::posix_time::seconds(5));
+    client->call_method("slow", {}, [&](std::string const& id, nlohmann::json const& result, nlohmann::json const& error) {
+        slow_error = error;
+        ++calls;
+    }, boost::posix_time::milliseconds(50));
+    BOOST_CHECK_EQUAL(client->pending_methods(), 2);
+
+    BOOST_REQUIRE(run_until([&]() { return calls == 2; }));
+    BOOST_CHECK_EQUAL(fast_result, 7);
+    BOOST_CHECK_EQUAL(slow_error["error"], "timeout");
+    BOOST_CHECK_EQUAL(client->pending_methods(), 0);
+
+    run_until([]() { return false; }, boost::posix_time::milliseconds(100));
+    BOOST_CHECK_EQUAL(calls, 2);
+}
+
+BOOST_FIXTURE_TEST_CASE(ddp_replays_subscriptions, ddp_fixture)
+{
+    handler = [&](nlohmann::json const& payload) {
+        if(payload["msg"] == "sub" && payload["name"] == "items") {
+            reply({{ "msg", "ready" }, { "subs", { payload["id"] } }});
+        } else if(payload["msg"] == "sub") {
+            reply({{ "msg", "nosub" }, { "id", payload["id"] }, { "error", {{ "error", 404 }} }});
+        }
+    };
+    client->connect(url);
+
+    int ready = 0, failed = 0;
+    auto const items = client->subscribe("items", {}, [&](std::string const& id) { ++ready; });
+    auto const missing = client->subscribe("missing", {}, meteorpp::ddp::ready_signal::slot_function_type(), [&](std::string const& id, nlohmann::json const& error) { ++failed; });
+    BOOST_REQUIRE(run_until([&]() { return ready == 1 && failed == 1; }));
+    BOOST_CHECK(client->subscription_status(items) == meteorpp::ddp::subscription_state::ready);
+    BOOST_CHECK(client->subscription_status(missing) == meteorpp::ddp::subscription_state::failed);
+
+    std::string reconnected;
+    client->on_reconnected([&](std::string const& session) {
+        reconnected = session;
+        BOOST_CHECK(client->subscription_status(items) == meteorpp::ddp::subscription_state::ready);
+    });
+    drop();
+    BOOST_REQUIRE(run_until([&]() { return ready == 2; }));
+
+    BOOST_CHECK_EQUAL(reconnected, "session2");
+    BOOST_REQUIRE_EQUAL(sessions.size(), 2);
+    BOOST_CHECK_EQUAL(sessions.back(), "session1");
+    BOOST_CHECK_EQUAL(count_received("sub"), 3);
+    BOOST_CHECK_EQUAL(received.back()["id"].get<std::string>(), items);
+    BOOST_CHECK_EQUAL(failed, 1);
+}
+
+BOOST_FIXTURE_TEST_CASE(ddp_collection_reconciles_on_reconnect, ddp_fixture)
+{
+    std::vector<nlohmann::json> initial_batch = {
+        {{ "msg", "added" }, { "collection", "items" }, { "id", "a" }, { "fields", {{ "n", 1 }} }},
+        {{ "msg", "added" }, { "collection", "items" }, { "id", "b" }, { "fields", {{ "n", 1 }} }}
+    };
+    handler = [&](nlohmann::json const& payload) {
+        if(payload["msg"] == "sub") {
+            for(auto const& message: initial_batch) {
+                reply(message);
+            }
+            reply({{ "msg", "ready" }, { "subs", { payload["id"] } }});
+        }
+    };
+
+    std::shared_ptr<meteorpp::memory_ddp_collection> coll;
+    int ready = 0;
+    client->connect(url, [&](std::string const& session) {
+        coll = std::make_shared<meteorpp::memory_ddp_collection>(client, "items");
+        coll->on_ready([&]() { ++ready; });
+    });
+    BOOST_REQUIRE(run_until([&]() { return ready == 1; }));
+    BOOST_CHECK_EQUAL(coll->count(), 2);
+
+    coll->update({{ "_id", "a" }}, {{ "$set", {{ "n", 5 }} }});
+    BOOST_REQUIRE(run_until([&]() { return count_received("method") == 1; }));
+
+    initial_batch = {
+        {{ "msg", "added" }, { "collection", "items" }, { "id", "a" }, { "fields", {{ "n", 2 }} }},
+        {{ "msg", "added" }, { "collection", "items" }, { "id", "c" }, { "fields", {{ "n", 3 }} }}
+    };
+    coll->on_ready([&]() { ++ready; });
+    drop();
+    BOOST_REQUIRE(run_until([&]() { return ready == 2; }));
+
+    BOOST_CHECK_EQUAL(coll->count(), 2);
+    BOOST_CHECK_EQUAL(coll->find_one({{ "_id", "a" }})["n"], 2);
+    BOOST_CHECK_EQUAL(coll->find_one({{ "_id", "c" }})["n"], 3);
+    BOOST_CHECK(coll->find_one({{ "_id", "b" }}).empty());
+}
+
+BOOST_FIXTURE_TEST_CASE(ddp_answers_pings_immediately, ddp_fixture)
+{
+    client->set_send_batching(boost::posix_time::seconds(10), 0);
+    client->connect(url, [&](std::string const& session) {
+        reply({{ "msg", "ping" }});
+    });
+    BOOST_CHECK(run_until([&]() { return count_received("pong") == 1; }, boost::posix_time::seconds(2)));
+}
+
+BOOST_FIXTURE_TEST_CASE(ddp_queues_messages_while_offline, ddp_fixture)
+{
+    handler = [&](nlohmann::json const& payload) {
+        if(payload["msg"] == "sub") {
+            reply({{ "msg", "ready" }, { "subs", { payload["id"] } }});
+        } else if(payload["msg"] == "method") {
+            reply({{ "msg", "result" }, { "id", payload["id"] }, { "result", true }});
+        }
+    };
+    client->set_max_queued_messages(2);
+    client->set_reconnect_delay(boost::posix_time::milliseconds(200), boost::posix_time::milliseconds(200));
+    client->connect(url);
+
+    int ready = 0, results = 0;
+    client->subscribe("before", {}, [&](std::string const& id) { ++ready; });
+    BOOST_REQUIRE(run_until([&]() { return ready == 1; }));
+
+    drop();
+    run_until([]() { return false; }, boost::posix_time::milliseconds(50));
+    auto const items = client->subscribe("items", {}, [&](std::string const& id) { ++ready; });
+    client->call_method("m", {}, [&](std::string const& id, nlohmann::json const& result, nlohmann::json const& error) { ++results; });
+    BOOST_CHECK_THROW(client->call_method("m"), websocketpp::exception);
+    BOOST_CHECK_EQUAL(client->pending_methods(), 1);
+
+    BOOST_REQUIRE(run_until([&]() { return ready == 3 && results == 1; }));
+    run_until([]() { return false; }, boost::posix_time::milliseconds(50));
+    BOOST_CHECK_EQUAL(count_received("sub"), 3);
+    BOOST_CHECK_EQUAL(std::count_if(received.begin(), received.end(), [&](nlohmann::json const& payload) { return payload["msg"] == "sub" && payload["id"] == items; }), 1);
+}
+
+BOOST_FIXTURE_TEST_CASE(ddp_fails_pending_methods_on_drop, ddp_fixture)
 {
+    client->connect(url);
+
+    nlohmann::json error;
+    int calls = 0;
+    client->call_method("never", {}, [&](std::string const& id, nlohmann::json const& result, nlohmann::json const& e) {
+        error = e;
+        ++calls;
+    });
+    BOOST_REQUIRE(run_until([&]() { return count_received("method") == 1; }));
+    BOOST_CHECK_EQUAL(client->pending_methods(), 1);
+
+    drop();
+    BOOST_REQUIRE(run_until([&]() { return calls == 1; }));
+    BOOST_CHECK_EQUAL(error["error"], "disconnected");
+    BOOST_CHECK_EQUAL(client->pending_methods(), 0);
+
+    BOOST_REQUIRE(run_until([&]() { return sessions.size() == 2; }));
+    run_until([]() { return false; }, boost::posix_time::milliseconds(50));
+    BOOST_CHECK_EQUAL(calls, 1);
+}
+
+BOOST_FIXTURE_TEST_CASE(ddp_first_session_is_not_a_reconnection, ddp_fixture)
+{
+    websocketpp::lib::asio::error_code error_code;
+    auto const endpoint = server.get_local_endpoint(error_code);
+    server.stop_listening();
+
+    int connected = 0, reconnected = 0;
+    client->on_connected([&](std::string const& session) { ++connected; });
+    client->on_reconnected([&](std::string const& session) { ++reconnected; });
+    client->connect(url);
+    run_until([]() { return false; }, boost::posix_time::milliseconds(50));
+
+    server.listen(endpoint);
+    server.start_accept();
+    BOOST_REQUIRE(run_until([&]() { return connected == 1; }));
+    BOOST_CHECK_EQUAL(reconnected, 0);
+
+    drop();
+    BOOST_REQUIRE(run_until([&]() { return connected == 2; }));
+    BOOST_CHECK_EQUAL(reconnected, 1);
+}
+
+BOOST_FIXTURE_TEST_CASE(ddp_unsubscribes_while_offline, ddp_fixture)
+{
+    std::set<std::string> published;
+    handler = [&](nlohmann::json const& payload) {
+        if(payload["msg"] == "sub") {
+            published.insert(payload["id"].get<std::string>());
+            reply({{ "msg", "ready" }, { "subs", { payload["id"] } }});
+        } else if(payload["msg"] == "unsub") {
+            published.erase(payload["id"].get<std::string>());
+        }
+    };
+    client->set_reconnect_delay(boost::posix_time::milliseconds(200), boost::posix_time::milliseconds(200));
+    client->connect(url);
+    BOOST_REQUIRE(run_until([&]() { return sessions.size() == 1; }));
+
+    drop();
+    run_until([]() { return false; }, boost::posix_time::milliseconds(50));
+    int ready = 0;
+    auto const dropped = client->subscribe("dropped");
+    client->subscribe("kept", {}, [&](std::string const& id) { ++ready; });
+    client->unsubscribe(dropped);
+    BOOST_CHECK(client->subscription_status(dropped) == meteorpp::ddp::subscription_state::stopped);
+
+    BOOST_REQUIRE(run_until([&]() { return ready == 1; }));
+    run_until([]() { return false; }, boost::posix_time::milliseconds(50));
+    BOOST_CHECK_EQUAL(published.size(), 1);
+    BOOST_CHECK_EQUAL(published.count(dropped), 0);
+}
+
+BOOST_FIXTURE_TEST_CASE(ddp_tracks_messages_flushed_by_send, ddp_fixture)
+{
+    handler = [&](nlohmann::json const& payload) {
+        if(payload["msg"] == "sub") {
+            reply({{ "msg", "ready" }, { "subs", { payload["id"] } }});
+        }
+    };
+    client->set_send_batching(boost::posix_time::time_duration(), 1);
+    client->connect(url);
+    BOOST_REQUIRE(run_until([&]() { return sessions.size() == 1; }));
+
+    nlohmann::json error;
+    client->call_method("never", {}, [&](std::string const& id, nlohmann::json const& result, nlohmann::json const& e) { error = e; });
+    BOOST_REQUIRE(run_until([&]() { return count_received("method") == 1; }));
+    drop();
+    BOOST_REQUIRE(run_until([&]() { return !error.is_null(); }));
+    BOOST_CHECK_EQUAL(error["error"], "disconnected");
+    BOOST_CHECK_EQUAL(client->pending_methods(), 0);
+
+    BOOST_REQUIRE(run_until([&]() { return sessions.size() == 2; }));
+    int ready = 0;
+    client->subscribe("items", {}, [&](std::string const& id) { ++ready; });
+    BOOST_REQUIRE(run_until([&]() { return ready == 1; }));
+    drop();
+    BOOST_REQUIRE(run_until([&]() { return ready == 2; }));
+    BOOST_CHECK_EQUAL(count_received("sub"), 2);
 }
@@ -0,0 +1,59 @@
+#include <meteorpp/live_query.hpp>
+#include <boost/test/unit_test.hpp>
+
+struct live_query_fixture {
+    live_query_fixture() : coll(std::make_shared<meteorpp::collection>("test")) {}
+    std::shared_ptr<meteorpp::collection> coll;
+};
+
+BOOST_FIXTURE_TEST_CASE(live_query_insert_many_notifies_once, live_query_fixture)
+{
+    auto const live_query = coll->track({{ "foo", "bar" }});
+
+    int updates = 0, added = 0;
+    live_query->on_changed([&]() { ++updates; });
+    live_query->on_document_added([&](std::string const& id, nlohmann::json::object_t const& fields) { ++added; });
+
+    coll->insert_many({{{ "foo", "bar" }}, {{ "foo", "baz" }}, {{ "foo", "bar" }}});
+    BOOST_CHECK_EQUAL(updates, 1);
+    BOOST_CHECK_EQUAL(added, 2);
+    BOOST_CHECK_EQUAL(live_query->data().size(), 2);
+}
+
+BOOST_FIXTURE_TEST_CASE(live_query_upsert_existing_notifies_change, live_query_fixture)
+{
+    coll->insert({{ "foo", "bar" }});
+    auto const live_query = coll->track({{ "foo", "bar" }});
+
+    int added = 0, changed = 0;
+    live_query->on_document_added([&](std::string const& id, nlohmann::json::object_t const& fields) { ++added; });
+    live_query->on_document_changed([&](std::string const& id, nlohmann::json::object_t const& fields, std::vector<std::string> const& cleared) { ++changed; });
+
+    BOOST_CHECK_EQUAL(coll->upsert({{ "foo", "bar" }}, {{ "bar", "foo" }}), 1);
+    BOOST_CHECK_EQUAL(added, 0);
+    BOOST_CHECK_EQUAL(changed, 1);
+    BOOST_CHECK_EQUAL(coll->count(), 1);
+}
+
+BOOST_FIXTURE_TEST_CASE(live_query_refills_after_batch, live_query_fixture)
+{
+    auto const ids = coll->insert_many({{{ "g", "on" }, { "n", 1 }}, {{ "g", "on" }, { "n", 2 }}, {{ "g", "on" }, { "n", 3 }}});
+
+    meteorpp::find_options options;
+    options.sort = {{ "n", 1 }};
+    options.limit = 2;
+    auto const live_query = coll->track({{ "g", "on" }}, options);
+
+    std::vector<nlohmann::json::object_t> added;
+    int changed = 0;
+    live_query->on_document_added([&](std::string const& id, nlohmann::json::object_t const& fields) { added.push_back(fields); });
+    live_query->on_document_changed([&](std::string const& id, nlohmann::json::object_t const& fields, std::vector<std::string> const& cleared) { ++changed; });
+
+    coll->update_many({{ {{ "_id", ids[0] }}, {{ "$set", {{ "g", "off" }} }} }, { {{ "_id", ids[2] }}, {{ "$set", {{ "x", 1 }} }} }});
+    BOOST_REQUIRE_EQUAL(added.size(), 1);
+    BOOST_CHECK_EQUAL(added.front()["x"], 1);
+    BOOST_CHECK_EQUAL(changed, 0);
+    BOOST_REQUIRE_EQUAL(live_query->size(), 2);
+    BOOST_CHECK_EQUAL(live_query->data()[1]["_id"].get<std::string>(), ids[2]);
+    BOOST_CHECK_EQUAL(live_query->data()[1]["x"], 1);
+}
@@ -0,0 +1,572 @@
+#include <meteorpp/live_aggregate.hpp>
+#include <meteorpp/live_query.hpp>
+#include <meteorpp/live_query_router.hpp>
+#include <meteorpp/memory_collection.hpp>
+#include <meteorpp/modifier.hpp>
+#include <meteorpp/selector.hpp>
+#include <boost/test/unit_test.hpp>
+
+struct memory_fixture {
+    memory_fixture() : coll(std::make_shared<meteorpp::memory_collection>("test")) {}
+    std::shared_ptr<meteorpp::memory_collection> coll;
+};
+
+bool matches(nlohmann::json::object_t const& selector, nlohmann::json::object_t const& document)
+{
+    return meteorpp::selector(selector).match(document);
+}
+
+BOOST_AUTO_TEST_CASE(selector_operators)
+{
+    nlohmann::json::object_t const doc = {{ "a", 5 }, { "tags", { "x", "y" } }, { "sub", {{ "b", "Hello" }} }, { "items", { {{ "n", 1 }}, {{ "n", 3 }} } }};
+
+    BOOST_CHECK(matches({}, doc));
+    BOOST_CHECK(matches({{ "a", 5 }}, doc));
+    BOOST_CHECK(matches({{ "a", {{ "$gt", 4 }, { "$lte", 5 }} }}, doc));
+    BOOST_CHECK(!matches({{ "a", {{ "$in", { 1, 2 } }} }}, doc));
+    BOOST_CHECK(matches({{ "tags", "y" }}, doc));
+    BOOST_CHECK(matches({{ "sub.b", {{ "$regex", "^hel" }, { "$options", "i" }} }}, doc));
+    BOOST_CHECK(matches({{ "items.n", 3 }}, doc));
+    BOOST_CHECK(matches({{ "missing", {{ "$exists", false }} }}, doc));
+    BOOST_CHECK(matches({{ "$or", { {{ "a", 1 }}, {{ "tags", {{ "$size", 2 }} }} } }}, doc));
+    BOOST_CHECK_THROW(matches({{ "a", {{ "$where", "true" }} }}, doc), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(selector_malformed_arguments)
+{
+    nlohmann::json::object_t const doc = {{ "name", "x" }, { "tags", { 1, 2 } }};
+
+    BOOST_CHECK_THROW(matches({{ "name", {{ "$regex", "(" }} }}, doc), std::invalid_argument);
+    BOOST_CHECK_THROW(matches({{ "tags", {{ "$size", "x" }} }}, doc), std::invalid_argument);
+    BOOST_CHECK_THROW(matches({{ "tags", {{ "$size", -1 }} }}, doc), std::invalid_argument);
+    BOOST_CHECK(!matches({{ "tags.99999999999999999999999", 1 }}, doc));
+
+    nlohmann::json::object_t pulled = {{ "_id", "1" }, { "names", { "a", "b" } }};
+    BOOST_CHECK_THROW(meteorpp::modifier({{ "$pull", {{ "names", {{ "$regex", "[" }} }} }}).apply(pulled), std::invalid_argument);
+
+    auto const coll = std::make_shared<meteorpp::memory_collection>("malformed");
+    BOOST_CHECK_THROW(coll->track({{ "name", {{ "$regex", "(" }} }}), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(modifier_operators)
+{
+    nlohmann::json::object_t doc = {{ "_id", "1" }, { "a", 1 }, { "list", { 1, 2 } }};
+    meteorpp::modifier({{ "$inc", {{ "a", 2 }} }, { "$set", {{ "sub.b", true }} }, { "$push", {{ "list", 3 }} }, { "$unset", {{ "missing", true }} }}).apply(doc);
+
+    nlohmann::json::object_t const expected = {{ "_id", "1" }, { "a", 3 }, { "list", { 1, 2, 3 } }, { "sub", {{ "b", true }} }};
+    BOOST_CHECK_EQUAL(nlohmann::json(doc), nlohmann::json(expected));
+
+    meteorpp::modifier({{ "c", 1 }}).apply(doc);
+    BOOST_CHECK_EQUAL(nlohmann::json(doc), nlohmann::json({{ "_id", "1" }, { "c", 1 }}));
+    BOOST_CHECK_THROW(meteorpp::modifier({{ "$set", {{ "_id", "2" }} }}).apply(doc), std::invalid_argument);
+    BOOST_CHECK_THROW(meteorpp::modifier({{ "$rename", {{ "c", "_id" }} }}).apply(doc), std::invalid_argument);
+    BOOST_CHECK_EQUAL(doc["_id"], "1");
+}
+
+BOOST_FIXTURE_TEST_CASE(memory_insert_find_update_remove, memory_fixture)
+{
+    auto const id = coll->insert({{ "foo", "bar" }, { "n", 1 }});
+    BOOST_CHECK_EQUAL(id.size(), 24);
+    coll->insert({{ "_id", "abc" }, { "foo", "baz" }, { "n", 2 }});
+    BOOST_CHECK_THROW(coll->insert({{ "_id", "abc" }}), std::runtime_error);
+
+    BOOST_CHECK_EQUAL(coll->count(), 2);
+    BOOST_CHECK_EQUAL(coll->find_one({{ "_id", "abc" }})["foo"], "baz");
+    BOOST_CHECK_EQUAL(coll->update({{ "foo", "bar" }}, {{ "$inc", {{ "n", 10 }} }}), 1);
+    BOOST_CHECK_EQUAL(coll->find_one({{ "_id", id }})["n"], 11);
+
+    meteorpp::find_options options;
+    options.sort = {{ "n", -1 }};
+    options.fields = {{ "n", 1 }};
+    auto const sorted = coll->find(nlohmann::json::object(), options);
+    BOOST_CHECK_EQUAL(nlohmann::json(sorted), nlohmann::json({ {{ "_id", id }, { "n", 11 }}, {{ "_id", "abc" }, { "n", 2 }} }));
+
+    BOOST_CHECK_EQUAL(coll->upsert({{ "foo", "qux" }}, {{ "foo", "qux" }}), 1);
+    BOOST_CHECK_EQUAL(coll->remove({{ "n", {{ "$lt", 5 }} }}), 1);
+    BOOST_CHECK_EQUAL(coll->count(), 2);
+}
+
+BOOST_FIXTURE_TEST_CASE(memory_sort_by_several_keys, memory_fixture)
+{
+    coll->insert_many({{{ "_id", "1" }, { "z", 2 }, { "a", 9 }}, {{ "_id", "2" }, { "z", 1 }, { "a", 1 }}, {{ "_id", "3" }, { "z", 1 }, { "a", 2 }}});
+
+    meteorpp::find_options options;
+    options.sort = {{ "z", 1 }, { "a", -1 }};
+    std::vector<std::string> ids;
+    for(auto const& doc: coll->find({}, options)) {
+        ids.push_back(doc.at("_id"));
+    }
+    BOOST_CHECK(ids == std::vector<std::string>({ "3", "2", "1" }));
+
+    auto const live_query = coll->track({}, options);
+    coll->insert({{ "_id", "4" }, { "z", 1 }, { "a", 3 }});
+    BOOST_CHECK_EQUAL(live_query->data()[0]["_id"].get<std::string>(), "4");
+    BOOST_CHECK_EQUAL(live_query->data()[3]["_id"].get<std::string>(), "1");
+
+    options.sort = {{ "a", -1 }, { "z", 1 }};
+    BOOST_CHECK_EQUAL(coll->find_one({}, options)["_id"].get<std::string>(), "1");
+}
+
+BOOST_FIXTURE_TEST_CASE(memory_index_lookup, memory_fixture)
+{
+    coll->insert_many({{{ "k", "a" }}, {{ "k", "b" }}, {{ "k", { "a", "c" } }}});
+    coll->ensure_index("k");
+    BOOST_CHECK(coll->indexes() == std::vector<std::string>{ "k" });
+
+    BOOST_CHECK_EQUAL(coll->count({{ "k", "a" }}), 2);
+    BOOST_CHECK_EQUAL(coll->count({{ "k", {{ "$in", { "b", "c" } }} }}), 2);
+
+    coll->update({{ "k", "b" }}, {{ "$set", {{ "k", "a" }} }});
+    BOOST_CHECK_EQUAL(coll->count({{ "k", "a" }}), 3);
+    BOOST_CHECK_EQUAL(coll->count({{ "k", "b" }}), 0);
+
+    coll->drop_index("k");
+    BOOST_CHECK(coll->indexes().empty());
+    BOOST_CHECK_EQUAL(coll->count({{ "k", "a" }}), 3);
+}
+
+BOOST_FIXTURE_TEST_CASE(memory_update_many_rolls_back, memory_fixture)
+{
+    auto const id = coll->insert({{ "n", 1 }, { "s", "text" }});
+    BOOST_CHECK_THROW(coll->update_many({{ {{ "_id", id }}, {{ "$inc", {{ "n", 1 }} }} }, { {{ "_id", id }}, {{ "$inc", {{ "s", 1 }} }} }}), std::runtime_error);
+    BOOST_CHECK_EQUAL(coll->find_one()["n"], 1);
+}
+
+BOOST_FIXTURE_TEST_CASE(memory_remove_many_rolls_back_in_order, memory_fixture)
+{
+    coll->insert_many({{{ "_id", "1" }, { "k", "a" }}, {{ "_id", "2" }, { "k", "b" }}, {{ "_id", "3" }, { "k", "b" }}, {{ "_id", "4" }, { "k", "a" }}});
+    coll->ensure_index("k");
+
+    BOOST_CHECK_THROW(coll->remove_many({{{ "_id", "3" }}, {{ "_id", "2" }}, {{ "k", {{ "$where", "true" }} }}}), std::runtime_error);
+    std::vector<std::string> ids;
+    for(auto const& doc: coll->find()) {
+        ids.push_back(doc.at("_id"));
+    }
+    BOOST_CHECK(ids == std::vector<std::string>({ "1", "2", "3", "4" }));
+    BOOST_CHECK_EQUAL(coll->count({{ "k", "b" }}), 2);
+
+    coll->remove({{ "_id", "2" }});
+    BOOST_CHECK_EQUAL(coll->count({{ "k", "b" }}), 1);
+}
+
+BOOST_FIXTURE_TEST_CASE(memory_live_query, memory_fixture)
+{
+    auto const live_query = coll->track({{ "foo", "bar" }});
+
+    int updates = 0;
+    live_query->on_changed([&]() { ++updates; });
+
+    coll->insert_many({{{ "foo", "bar" }}, {{ "foo", "baz" }}});
+    BOOST_CHECK_EQUAL(updates, 1);
+    BOOST_CHECK_EQUAL(live_query->data().size(), 1);
+
+    coll->update({{ "foo", "baz" }}, {{ "$set", {{ "foo", "bar" }} }});
+    BOOST_CHECK_EQUAL(live_query->data().size(), 2);
+
+    coll->remove({{ "foo", "bar" }});
+    BOOST_CHECK(live_query->data().empty());
+}
+
+BOOST_FIXTURE_TEST_CASE(memory_live_query_keeps_order, memory_fixture)
+{
+    auto const ids = coll->insert_many({{{ "n", 1 }}, {{ "n", 2 }}, {{ "n", 3 }}});
+    auto const live_query = coll->track();
+    BOOST_CHECK_EQUAL(live_query->size(), 3);
+
+    coll->update({{ "n", 2 }}, {{ "$set", {{ "n", 20 }} }});
+    BOOST_CHECK_EQUAL(live_query->find(ids[1])->at("n"), 20);
+    BOOST_CHECK_EQUAL(live_query->data()[1]["n"], 20);
+
+    coll->remove({{ "n", 1 }});
+    BOOST_CHECK(live_query->find(ids[0]) == nullptr);
+    BOOST_CHECK_EQUAL(live_query->data().size(), 2);
+    BOOST_CHECK(live_query->data()[0]["_id"] == ids[1]);
+
+    std::vector<int> values;
+    for(auto const& document: live_query->documents()) {
+        values.push_back(document.at("n"));
+    }
+    BOOST_CHECK((values == std::vector<int>{ 20, 3 }));
+}
+
+BOOST_FIXTURE_TEST_CASE(memory_live_query_top_n, memory_fixture)
+{
+    for(auto i = 0; i < 10; ++i) {
+        coll->insert({{ "_id", "doc" + std::to_string(i) }, { "score", i }});
+    }
+
+    meteorpp::find_options options;
+    options.sort = {{ "score", -1 }};
+    options.limit = 3;
+    auto const live_query = coll->track(nlohmann::json::object(), options);
+
+    std::vector<std::string> events;
+    live_query->on_document_added_before([&](std::string const& id, nlohmann::json::object_t const& fields, std::string const& before) {
+        events.push_back("added " + id + " before " + before);
+    });
+    live_query->on_document_moved_before([&](std::string const& id, std::string const& before) {
+        events.push_back("moved " + id + " before " + before);
+    });
+    live_query->on_document_removed([&](std::string const& id) {
+        events.push_back("removed " + id);
+    });
+
+    auto const ids = [&]() {
+        std::vector<std::string> ids;
+        for(auto const& document: live_query->data()) {
+            ids.push_back(document["_id"]);
+        }
+        return ids;
+    };
+    BOOST_CHECK((ids() == std::vector<std::string>{ "doc9", "doc8", "doc7" }));
+
+    coll->insert({{ "_id", "new" }, { "score", 8.5 }});
+    BOOST_CHECK((ids() == std::vector<std::string>{ "doc9", "new", "doc8" }));
+
+    coll->update({{ "_id", "doc8" }}, {{ "$set", {{ "score", 10 }} }});
+    BOOST_CHECK((ids() == std::vector<std::string>{ "doc8", "doc9", "new" }));
+
+    coll->remove({{ "_id", "doc9" }});
+    BOOST_CHECK((ids() == std::vector<std::string>{ "doc8", "new", "doc7" }));
+
+    coll->update({{ "_id", "doc8" }}, {{ "$set", {{ "score", 0.5 }} }});
+    BOOST_CHECK((ids() == std::vector<std::string>{ "new", "doc7", "doc6" }));
+
+    std::vector<std::string> const expected = {
+        "removed doc7", "added new before doc8",
+        "moved doc8 before doc9",
+        "removed doc9", "added doc7 before ",
+        "removed doc8", "added doc6 before "
+    };
+    BOOST_CHECK_EQUAL_COLLECTIONS(events.begin(), events.end(), expected.begin(), expected.end());
+}
+
+BOOST_FIXTURE_TEST_CASE(memory_live_query_top_n_ties, memory_fixture)
+{
+    coll->insert_many({{{ "_id", "x" }, { "g", 5 }}, {{ "_id", "a" }, { "g", 1 }}, {{ "_id", "b" }, { "g", 1 }}, {{ "_id", "c" }}});
+
+    meteorpp::find_options options;
+    options.sort = {{ "g", 1 }};
+    options.limit = 2;
+    auto const live_query = coll->track(nlohmann::json::object(), options);
+
+    auto const ids = [&]() {
+        std::vector<std::string> ids;
+        for(auto const& document: live_query->data()) {
+            ids.push_back(document["_id"]);
+        }
+        return ids;
+    };
+    BOOST_CHECK((ids() == std::vector<std::string>{ "c", "a" }));
+
+    coll->remove({{ "_id", "c" }});
+    BOOST_CHECK((ids() == std::vector<std::string>{ "a", "b" }));
+
+    coll->update({{ "_id", "x" }}, {{ "$set", {{ "g", 1 }} }});
+    coll->remove({{ "_id", "a" }});
+    BOOST_CHECK((ids() == std::vector<std::string>{ "b", "x" }));
+
+    coll->insert({{ "_id", "y" }, { "g", 1 }});
+    coll->update({{ "_id", "b" }}, {{ "$set", {{ "g", 2 }} }});
+    BOOST_CHECK((ids() == std::vector<std::string>{ "x", "y" }));
+
+    options.sort.emplace_back("_id", 1);
+    std::vector<std::string> expected;
+    for(auto const& document: coll->find({}, options)) {
+        expected.push_back(document.at("_id"));
+    }
+    BOOST_CHECK(ids() == expected);
+}
+
+BOOST_FIXTURE_TEST_CASE(memory_live_query_routing, memory_fixture)
+{
+    auto const by_owner = coll->track({{ "owner", "alice" }});
+    auto const by_range = coll->track({{ "age", {{ "$gte", 18 }, { "$lt", 65 }} }});
+    auto const by_tags = coll->track({{ "tags", {{ "$in", { "a", "b" } }} }});
+    auto const all = coll->track({{ "$or", { {{ "owner", "bob" }}, {{ "age", 5 }} } }});
+
+    auto const id = coll->insert({{ "owner", "alice" }, { "age", 30 }, { "tags", { "c", "a" } }});
+    coll->insert({{ "owner", "bob" }, { "age", 70 }});
+    BOOST_CHECK_EQUAL(by_owner->size(), 1);
+    BOOST_CHECK_EQUAL(by_range->size(), 1);
+    BOOST_CHECK_EQUAL(by_tags->size(), 1);
+    BOOST_CHECK_EQUAL(all->size(), 1);
+
+    coll->update({{ "_id", id }}, {{ "$set", {{ "owner", "carol" }, { "age", 10 }, { "tags", { "b" } }} }});
+    BOOST_CHECK_EQUAL(by_owner->size(), 0);
+    BOOST_CHECK_EQUAL(by_range->size(), 0);
+    BOOST_CHECK_EQUAL(by_tags->size(), 1);
+
+    coll->remove({{ "_id", id }});
+    BOOST_CHECK_EQUAL(by_tags->size(), 0);
+}
+
+BOOST_FIXTURE_TEST_CASE(memory_live_query_coalesce, memory_fixture)
+{
+    boost::asio::io_service io;
+    auto const live_query = coll->track();
+    live_query->coalesce(io);
+
+    int updates = 0;
+    meteorpp::live_query::change_set changes;
+    live_query->on_changed([&]() { ++updates; });
+    live_query->on_changes([&](meteorpp::live_query::change_set const& c) { changes = c; });
+
+    auto const kept = coll->insert({{ "n", 1 }});
+    auto const dropped = coll->insert({{ "n", 2 }});
+    coll->update({{ "_id", kept }}, {{ "$set", {{ "n", 10 }} }});
+    coll->remove({{ "_id", dropped }});
+    BOOST_CHECK_EQUAL(updates, 0);
+
+    io.poll();
+    BOOST_CHECK_EQUAL(updates, 1);
+    BOOST_CHECK_EQUAL(changes.added.size(), 1);
+    BOOST_CHECK_EQUAL(changes.added[kept]["n"], 10);
+    BOOST_CHECK(changes.changed.empty());
+    BOOST_CHECK(changes.removed.empty());
+
+    coll->update({{ "_id", kept }}, {{ "$unset", {{ "n", true }} }});
+    io.reset();
+    io.poll();
+    BOOST_CHECK_EQUAL(updates, 2);
+    BOOST_CHECK(changes.added.empty());
+    BOOST_CHECK(changes.changed[kept].second == std::vector<std::string>{ "n" });
+}
+
+BOOST_FIXTURE_TEST_CASE(memory_live_query_multiplexing, memory_fixture)
+{
+    auto first = coll->track({{ "foo", "bar" }});
+    auto const second = coll->track({{ "foo", "bar" }});
+    auto const other = coll->track({{ "foo", "baz" }});
+    BOOST_CHECK_EQUAL(&first->data(), &second->data());
+    BOOST_CHECK_NE(&first->data(), &other->data());
+
+    int first_added = 0, second_added = 0;
+    first->on_document_added([&](std::string const& id, nlohmann::json::object_t const& fields) { ++first_added; });
+    second->on_document_added([&](std::string const& id, nlohmann::json::object_t const& fields) { ++second_added; });
+
+    coll->insert({{ "foo", "bar" }});
+    BOOST_CHECK_EQUAL(first_added, 1);
+    BOOST_CHECK_EQUAL(second_added, 1);
+
+    first.reset();
+    coll->insert({{ "foo", "bar" }});
+    BOOST_CHECK_EQUAL(first_added, 1);
+    BOOST_CHECK_EQUAL(second_added, 2);
+    BOOST_CHECK_EQUAL(second->size(), 2);
+}
+
+BOOST_FIXTURE_TEST_CASE(memory_live_aggregate, memory_fixture)
+{
+    coll->insert({{ "team", "a" }, { "score", 3 }});
+    auto const aggregate = coll->aggregate({{ "score", {{ "$gt", 0 }} }}, "score", "team");
+    BOOST_CHECK_EQUAL(aggregate->total().count, 1);
+
+    int updates = 0;
+    aggregate->on_changed([&]() { ++updates; });
+
+    auto const id = coll->insert({{ "team", "a" }, { "score", 7 }});
+    coll->insert({{ "team", "b" }, { "score", 5 }});
+    coll->insert({{ "team", "b" }, { "score", -1 }});
+    BOOST_CHECK_EQUAL(updates, 2);
+    BOOST_CHECK_EQUAL(aggregate->total().count, 3);
+    BOOST_CHECK_EQUAL(aggregate->total().sum(), 15);
+    BOOST_CHECK_EQUAL(aggregate->total().min(), 3);
+    BOOST_CHECK_EQUAL(aggregate->total().max(), 7);
+    BOOST_CHECK_EQUAL(aggregate->groups().size(), 2);
+    BOOST_CHECK_EQUAL(aggregate->groups().at("a").sum(), 10);
+
+    coll->update({{ "_id", id }}, {{ "$set", {{ "team", "b" }, { "score", 1 }} }});
+    BOOST_CHECK_EQUAL(aggregate->groups().at("a").count, 1);
+    BOOST_CHECK_EQUAL(aggregate->groups().at("b").sum(), 6);
+    BOOST_CHECK_EQUAL(aggregate->total().max(), 5);
+
+    coll->remove({{ "team", "a" }});
+    BOOST_CHECK_EQUAL(aggregate->groups().count("a"), 0);
+    BOOST_CHECK_EQUAL(aggregate->total().min(), 1);
+    BOOST_CHECK_EQUAL(updates, 4);
+}
+
+BOOST_FIXTURE_TEST_CASE(memory_live_aggregate_exact_sum, memory_fixture)
+{
+    auto const aggregate = coll->aggregate({}, "n", "");
+    int updates = 0;
+    aggregate->on_changed([&]() { ++updates; });
+
+    auto const ids = coll->insert_many({{{ "n", 9007199254740993 }}, {{ "n", 1 }}});
+    BOOST_CHECK_EQUAL(updates, 1);
+    BOOST_CHECK(aggregate->total().sum().is_number_integer());
+    BOOST_CHECK_EQUAL(aggregate->total().sum(), 9007199254740994);
+
+    coll->remove({{ "_id", ids.front() }});
+    auto const big = coll->insert({{ "n", 1e16 }});
+    auto const one = coll->insert({{ "n", 1.0 }});
+    coll->remove({{ "_id", big }});
+    BOOST_CHECK_EQUAL(aggregate->total().sum(), 2.0);
+
+    coll->remove({{ "_id", one }});
+    BOOST_CHECK(aggregate->total().sum().is_number_integer());
+    BOOST_CHECK_EQUAL(aggregate->total().sum(), 1);
+}
+
+BOOST_FIXTURE_TEST_CASE(memory_live_query_nested_changes, memory_fixture)
+{
+    boost::asio::io_service io;
+    auto const id = coll->insert({{ "profile", {{ "name", "foo" }, { "age", 42 }, { "tags", { "a", "b" }} }}});
+    auto const live_query = coll->track();
+
+    nlohmann::json::object_t fields;
+    std::vector<std::string> cleared;
+    live_query->on_document_changed([&](std::string const& id, nlohmann::json::object_t const& f, std::vector<std::string> const& c) { fields = f; cleared = c; });
+
+    coll->update({{ "_id", id }}, {{ "$set", {{ "profile.name", "bar" }} }});
+    BOOST_CHECK(fields == nlohmann::json::object_t({{ "profile.name", "bar" }}));
+    BOOST_CHECK(cleared.empty());
+
+    coll->update({{ "_id", id }}, {{ "$unset", {{ "profile.age", true }} }});
+    BOOST_CHECK(fields.empty());
+    BOOST_CHECK(cleared == std::vector<std::string>{ "profile.age" });
+
+    meteorpp::live_query::change_set changes;
+    live_query->on_changes([&](meteorpp::live_query::change_set const& c) { changes = c; });
+    live_query->coalesce(io);
+
+    coll->update({{ "_id", id }}, {{ "$set", {{ "profile.name", "baz" }} }});
+    coll->update({{ "_id", id }}, {{ "$unset", {{ "profile", true }} }});
+    coll->update({{ "_id", id }}, {{ "$set", {{ "profile.age", 7 }} }});
+    io.poll();
+    BOOST_CHECK(changes.changed[id].first == nlohmann::json::object_t({{ "profile", {{ "age", 7 }} }}));
+    BOOST_CHECK(changes.changed[id].second.empty());
+}
+
+BOOST_FIXTURE_TEST_CASE(memory_live_query_snapshot, memory_fixture)
+{
+    auto const first = coll->insert({{ "n", 1 }});
+    auto const second = coll->insert({{ "n", 2 }});
+    meteorpp::find_options options;
+    options.sort = {{ "n", 1 }};
+    auto const live_query = coll->track({}, options);
+
+    auto const before = live_query->current_snapshot();
+    BOOST_CHECK_EQUAL(before->documents.size(), 2);
+    BOOST_CHECK(before->data() == live_query->data());
+
+    coll->update({{ "_id", second }}, {{ "$set", {{ "n", 0 }} }});
+    auto const after = live_query->current_snapshot();
+    BOOST_CHECK_EQUAL(after->version, before->version + 1);
+    BOOST_CHECK_EQUAL(after->documents.front()->at("_id").get<std::string>(), second);
+    BOOST_CHECK_EQUAL(before->documents.back()->at("n"), 2);
+    BOOST_CHECK_EQUAL(after->documents.back(), before->documents.front());
+    BOOST_CHECK_EQUAL(after->documents.back()->at("_id").get<std::string>(), first);
+
+    coll->update({{ "_id", first }}, {{ "$set", {{ "n", -1 }} }});
+    coll->update({{ "_id", second }}, {{ "$set", {{ "n", -2 }} }});
+    auto const latest = live_query->current_snapshot();
+    BOOST_CHECK_EQUAL(latest->version, after->version + 1);
+    BOOST_CHECK(latest->data() == live_query->data());
+    BOOST_CHECK_EQUAL(live_query->current_snapshot(), latest);
+}
+
+BOOST_AUTO_TEST_CASE(persistent_sequence_keeps_versions)
+{
+    std::vector<meteorpp::persistent_sequence::value_type> values;
+    for(auto i = 0; i < 100; ++i) {
+        values.push_back(std::make_shared<nlohmann::json::object_t const>(nlohmann::json::object_t({{ "n", i }})));
+    }
+    meteorpp::persistent_sequence const original(values);
+    auto const changed = original.erase(0).insert(50, values.front()).replace(99, values[1]);
+
+    BOOST_CHECK_EQUAL(original.size(), 100);
+    BOOST_CHECK(std::equal(original.begin(), original.end(), values.begin()));
+    BOOST_CHECK_EQUAL(changed.size(), 100);
+    BOOST_CHECK_EQUAL(changed.at(0), values[1]);
+    BOOST_CHECK_EQUAL(changed.at(50), values[0]);
+    BOOST_CHECK_EQUAL(changed.back(), values[1]);
+    BOOST_CHECK_THROW(changed.at(100), std::out_of_range);
+}
+
+BOOST_FIXTURE_TEST_CASE(memory_live_query_positions, memory_fixture)
+{
+    for(auto i = 0; i < 5; ++i) {
+        coll->insert({{ "_id", "doc" + std::to_string(i) }, { "score", i }});
+    }
+
+    meteorpp::find_options options;
+    options.sort = {{ "score", 1 }};
+    for(auto const& live_query: { coll->track(), coll->track(nlohmann::json::object(), options) }) {
+        std::vector<std::string> mirror;
+        for(auto const& document: live_query->data()) {
+            mirror.push_back(document["_id"]);
+        }
+        std::vector<boost::signals2::scoped_connection> connections;
+        connections.emplace_back(live_query->on_document_added_at([&](std::string const& id, nlohmann::json::object_t const& fields, std::size_t index) {
+            mirror.insert(mirror.begin() + index, id);
+        }));
+        connections.emplace_back(live_query->on_document_changed_at([&](std::string const& id, nlohmann::json::object_t const& fields, std::vector<std::string> const& cleared, std::size_t index) {
+            BOOST_CHECK_EQUAL(mirror.at(index), id);
+        }));
+        connections.emplace_back(live_query->on_document_moved_to([&](std::string const& id, std::size_t from, std::size_t to) {
+            BOOST_CHECK_EQUAL(mirror.at(from), id);
+            mirror.erase(mirror.begin() + from);
+            mirror.insert(mirror.begin() + to, id);
+        }));
+        connections.emplace_back(live_query->on_document_removed_at([&](std::string const& id, std::size_t index) {
+            BOOST_CHECK_EQUAL(mirror.at(index), id);
+            mirror.erase(mirror.begin() + index);
+        }));
+
+        coll->update({{ "_id", "doc0" }}, {{ "$set", {{ "score", 3.5 }} }});
+        coll->update({{ "_id", "doc4" }}, {{ "$set", {{ "score", -1 }} }});
+        coll->insert({{ "_id", "doc5" }, { "score", 2.5 }});
+        coll->remove({{ "_id", "doc2" }});
+
+        std::vector<std::string> ids;
+        for(auto const& document: live_query->data()) {
+            ids.push_back(document["_id"]);
+        }
+        BOOST_CHECK(mirror == ids);
+
+        coll->remove(nlohmann::json::object());
+        BOOST_CHECK(mirror.empty());
+        for(auto i = 0; i < 5; ++i) {
+            coll->insert({{ "_id", "doc" + std::to_string(i) }, { "score", i }});
+        }
+    }
+}
+
+struct counting_observer : meteorpp::live_query_router::observer {
+    void document_added(std::string const& id, nlohmann::json::object_t const& fields) { ++received; }
+    void document_changed(std::string const& id, nlohmann::json::object_t const& before, nlohmann::json::object_t const& after) { ++received; }
+    void document_removed(std::string const& id, nlohmann::json::object_t const& document) { ++received; }
+    void apply_batch(std::vector<meteorpp::live_query_router::change const*> const& changes) { received += changes.size(); }
+    int received = 0;
+};
+
+BOOST_AUTO_TEST_CASE(live_query_router_ranges)
+{
+    meteorpp::live_query_router router;
+    counting_observer above, below, between;
+    router.add(&above, {{ "age", {{ "$gt", 65 }} }});
+    router.add(&below, {{ "age", {{ "$lte", 18 }} }});
+    router.add(&between, {{ "age", {{ "$bt", { 30, 40 } }} }});
+
+    router.document_added("a", {{ "age", 50 }});
+    BOOST_CHECK_EQUAL(above.received, 0);
+    BOOST_CHECK_EQUAL(below.received, 0);
+    BOOST_CHECK_EQUAL(between.received, 0);
+
+    router.document_added("b", {{ "age", 18 }});
+    router.document_added("c", {{ "age", 65 }});
+    router.document_added("d", {{ "age", 35 }});
+    BOOST_CHECK_EQUAL(above.received, 0);
+    BOOST_CHECK_EQUAL(below.received, 1);
+    BOOST_CHECK_EQUAL(between.received, 1);
+
+    router.document_changed("a", {{ "_id", "a" }, { "age", 50 }}, {{ "_id", "a" }, { "age", 70 }});
+    BOOST_CHECK_EQUAL(above.received, 1);
+    BOOST_CHECK_EQUAL(below.received, 1);
+
+    router.remove(&below);
+    router.document_added("e", {{ "age", 1 }});
+    BOOST_CHECK_EQUAL(below.received, 1);
+}
@@ -1,6 +1,7 @@
 #include <set>
 
 #include <meteorpp/collection.hpp>
+#include <meteorpp/prepared_query.hpp>
 #include <boost/test/unit_test.hpp>
 
 struct fixture {
@@ -152,3 +153,160 @@ BOOST_FIXTURE_TEST_CASE(insert_multi_remove_one, fixture)
     BOOST_CHECK_EQUAL(it, 1);
     BOOST_CHECK_EQUAL(coll->find_one(), doc2);
 }
+
+BOOST_FIXTURE_TEST_CASE(upsert_insert, fixture)
+{
+    auto const it = coll->upsert({{ "foo", "bar" }}, {{ "foo", "bar" }, { "bar", "foo" }});
+    BOOST_CHECK_EQUAL(it, 1);
+    BOOST_CHECK_EQUAL(coll->count({{ "bar", "foo" }}), 1);
+}
+
+BOOST_FIXTURE_TEST_CASE(upsert_update, fixture)
+{
+    nlohmann::json::object_t doc = {{ "foo", "bar" }};
+    doc.insert(std::make_pair("_id", coll->insert(doc)));
+
+    auto const it = coll->upsert({{ "foo", "bar" }}, {{ "bar", "foo" }});
+    BOOST_CHECK_EQUAL(it, 1);
+
+    doc["bar"] = "foo";
+    BOOST_CHECK_EQUAL(coll->count(), 1);
+    BOOST_CHECK_EQUAL(coll->find_one(), doc);
+}
+
+BOOST_FIXTURE_TEST_CASE(insert_many, fixture)
+{
+    std::string const oid = "d776bb695e5447997999b1fd";
+    auto const ids = coll->insert_many({{{ "foo", "bar" }}, {{ "_id", oid }, { "foo", "baz" }}});
+
+    BOOST_CHECK_EQUAL(ids.size(), 2);
+    BOOST_CHECK_EQUAL(ids[1], oid);
+    BOOST_CHECK_EQUAL(coll->count(), 2);
+}
+
+BOOST_FIXTURE_TEST_CASE(insert_many_with_invalid_oid, fixture)
+{
+    BOOST_CHECK_THROW(coll->insert_many({{{ "foo", "bar" }}, {{ "_id", "0xe5505" }, { "foo", "baz" }}}), meteorpp::ejdb_exception);
+    BOOST_CHECK_EQUAL(coll->count(), 0);
+}
+
+BOOST_FIXTURE_TEST_CASE(update_remove_many, fixture)
+{
+    coll->insert_many({{{ "foo", "bar" }}, {{ "foo", "baz" }}, {{ "foo", "qux" }}});
+
+    auto const updated = coll->update_many({{{{ "foo", "bar" }}, {{ "$set", {{ "bar", "foo" }}}}}, {{{ "foo", "baz" }}, {{ "$set", {{ "bar", "foo" }}}}}});
+    BOOST_CHECK_EQUAL(updated, 2);
+    BOOST_CHECK_EQUAL(coll->count({{ "bar", "foo" }}), 2);
+
+    auto const removed = coll->remove_many({{{ "foo", "bar" }}, {{ "foo", "qux" }}});
+    BOOST_CHECK_EQUAL(removed, 2);
+    BOOST_CHECK_EQUAL(coll->count(), 1);
+}
+
+BOOST_FIXTURE_TEST_CASE(ensure_drop_index, fixture)
+{
+    typedef meteorpp::collection::index_type index_type;
+
+    coll->ensure_index("foo");
+    coll->ensure_index("bar", index_type::number);
+
+    auto indexes = coll->indexes();
+    std::sort(indexes.begin(), indexes.end());
+    std::vector<std::pair<std::string, index_type>> const excepted = {{ "bar", index_type::number }, { "foo", index_type::string }};
+    BOOST_CHECK(indexes == excepted);
+
+    coll->drop_index("foo");
+    BOOST_CHECK_EQUAL(coll->indexes().size(), 1);
+}
+
+BOOST_FIXTURE_TEST_CASE(insert_find_cursor, fixture)
+{
+    nlohmann::json::object_t doc1 = {{ "foo", "bar" }};
+    doc1.insert(std::make_pair("_id", coll->insert(doc1)));
+
+    nlohmann::json::object_t doc2 = {{ "foo", "baz" }};
+    doc2.insert(std::make_pair("_id", coll->insert(doc2)));
+
+    auto results = coll->find_cursor();
+    BOOST_CHECK_EQUAL(results.count(), 2);
+
+    std::vector<nlohmann::json::object_t> const excepted = { doc1, doc2 };
+    BOOST_CHECK_EQUAL_COLLECTIONS(results.begin(), results.end(), excepted.begin(), excepted.end());
+
+    for(auto const& doc: coll->find_cursor({{ "foo", "bar" }})) {
+        BOOST_CHECK_EQUAL(doc, doc1);
+        break;
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(prepared_query_reuse, fixture)
+{
+    auto const query = coll->prepare({{ "foo", "bar" }});
+    BOOST_CHECK_EQUAL(query->count(), 0);
+
+    nlohmann::json::object_t doc = {{ "foo", "bar" }};
+    doc.insert(std::make_pair("_id", coll->insert(doc)));
+    coll->insert({{ "foo", "baz" }});
+
+    BOOST_CHECK_EQUAL(query->count(), 1);
+    BOOST_CHECK_EQUAL(query->find_one(), doc);
+
+    coll->insert({{ "foo", "bar" }});
+    BOOST_CHECK_EQUAL(query->find().size(), 2);
+}
+
+BOOST_FIXTURE_TEST_CASE(query_cache_disabled, fixture)
+{
+    coll->set_query_cache_capacity(0);
+    coll->insert({{ "foo", "bar" }});
+    BOOST_CHECK_EQUAL(coll->count({{ "foo", "bar" }}), 1);
+    BOOST_CHECK_EQUAL(coll->count({{ "foo", "bar" }}), 1);
+}
+
+BOOST_FIXTURE_TEST_CASE(find_with_projection, fixture)
+{
+    auto const id = coll->insert({{ "foo", "bar" }, { "bar", "foo" }, { "baz", {{ "qux", 1 }} }});
+
+    meteorpp::find_options options;
+    options.fields = {{ "foo", 1 }};
+    nlohmann::json::object_t const included = {{ "_id", id }, { "foo", "bar" }};
+    BOOST_CHECK_EQUAL(coll->find_one({}, options), included);
+
+    options.fields = {{ "baz", 0 }};
+    nlohmann::json::object_t const excluded = {{ "_id", id }, { "foo", "bar" }, { "bar", "foo" }};
+    BOOST_CHECK_EQUAL(coll->find({}, options).front(), excluded);
+}
+
+BOOST_FIXTURE_TEST_CASE(find_with_sort_skip_limit, fixture)
+{
+    for(auto i = 0; i < 10; ++i) {
+        coll->insert({{ "index", i }});
+    }
+
+    meteorpp::find_options options;
+    options.sort = {{ "index", -1 }};
+    options.skip = 2;
+    options.limit = 3;
+    options.fields = {{ "index", 1 }};
+
+    std::vector<int> indexes;
+    for(auto const& doc: coll->find({}, options)) {
+        indexes.push_back(doc.at("index"));
+    }
+    std::vector<int> const excepted = { 7, 6, 5 };
+    BOOST_CHECK_EQUAL_COLLECTIONS(indexes.begin(), indexes.end(), excepted.begin(), excepted.end());
+
+    options.skip = 0;
+    BOOST_CHECK_EQUAL(coll->find_one({}, options).at("index"), 9);
+}
+
+BOOST_AUTO_TEST_CASE(open_database_keep)
+{
+    meteorpp::collection::set_database("meteorpp-keep.db", meteorpp::collection::open_mode::truncate);
+    std::make_shared<meteorpp::collection>("test")->insert({{ "foo", "bar" }});
+
+    meteorpp::collection::set_database("meteorpp-keep.db", meteorpp::collection::open_mode::keep);
+    BOOST_CHECK_EQUAL(std::make_shared<meteorpp::collection>("test")->count(), 1);
+
+    meteorpp::collection::set_database("meteorpp.db");
+}